@@ -483,6 +483,7 @@ char *yytext;
 #include "ast-parse.h"
 #include "stringtab.h"
 #include "utilities.h"
+#include "semant-alloc.h"   // interned strings count as string tables
 
 /* The compiler assumes these identifiers. */
 #define yylval ast_yylval
@@ -805,7 +806,8 @@ YY_RULE_SETUP
 case 2:
 YY_RULE_SETUP
 #line 78 "ast.flex"
-{ yylval.symbol = inttable.add_string(yytext,yyleng);
+{ AllocScope alloc(ALLOC_STRINGS);
+		  yylval.symbol = inttable.add_string(yytext,yyleng);
 		  return (INT_CONST); }
 	YY_BREAK
 case 3:
@@ -977,7 +979,8 @@ YY_RULE_SETUP
 case 36:
 YY_RULE_SETUP
 #line 119 "ast.flex"
-{ yylval.symbol = idtable.add_string(yytext, yyleng); 
+{ AllocScope alloc(ALLOC_STRINGS);
+		  yylval.symbol = idtable.add_string(yytext, yyleng); 
 		  return (ID); }
 	YY_BREAK
 /*
@@ -999,6 +1002,7 @@ YY_RULE_SETUP
 
                   BEGIN(INITIAL);
                   *string_buf_ptr = '\0';
+		  AllocScope alloc(ALLOC_STRINGS);
 		  yylval.symbol = 
 	               stringtable.add_string(string_buf,MAX_STR_CONST);
 		  return (STR_CONST);
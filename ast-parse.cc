@@ -84,6 +84,10 @@ Program ast_root;             /* the result of the parse  */
 Classes parse_results;        /* for use in parsing multiple files */
 int omerrs = 0;               /* number of errors in lexing and parsing */
 int current_line = 0;         /* debugging, current line for input file */
+int ast_parse_depth = 0;      /* deepest the parser stack got; grows with AST depth */
+
+/* deep expression chains need far more than the default 10000 entries */
+#define YYMAXDEPTH 10000000
 
 /* Line 371 of yacc.c  */
 #line 90 "ast.tab.c"
@@ -1371,6 +1375,8 @@ yyparse ()
 
  yysetstate:
   *yyssp = yystate;
+  if (yyssp - yyss + 1 > ast_parse_depth)
+    ast_parse_depth = yyssp - yyss + 1;
 
   if (yyss + yystacksize - 1 <= yyssp)
     {
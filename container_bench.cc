@@ -0,0 +1,347 @@
+//
+// Microbenchmarks for the containers under the checker: the string
+// tables, SymbolTable and list_node.
+//
+//   container_bench [-s scale] [filter]
+//
+// Each line gives the time and the number of heap allocations per
+// operation.  -s multiplies the number of repetitions; a filter runs
+// only the benchmarks whose name contains it.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <new>
+#include "cool-parse.h"
+#include "stringtab_functions.h"
+#include "symtab.h"
+#include "tree.h"
+#include "utilities.h"
+
+YYSTYPE cool_yylval;  /* needed to link with utilities.cc */
+
+//////////////////////////////////////////////////////////////////////
+//
+// Counting allocations
+//
+//////////////////////////////////////////////////////////////////////
+static long allocations = 0;
+
+void *operator new(size_t size){
+    allocations++;
+    void *p = malloc(size == 0 ? 1 : size);
+    if(p == NULL){
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void *operator new[](size_t size){
+    return operator new(size);
+}
+
+void operator delete(void *p) throw(){
+    free(p);
+}
+
+void operator delete[](void *p) throw(){
+    free(p);
+}
+
+void operator delete(void *p, size_t) throw(){
+    free(p);
+}
+
+void operator delete[](void *p, size_t) throw(){
+    free(p);
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// Timing
+//
+//////////////////////////////////////////////////////////////////////
+static int scale = 1;
+static const char *filter = NULL;
+static volatile long sink;   // keeps results from being thrown away
+
+static double now_ns(){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+class Bench {
+    const char *name;
+    int size;
+    double start;
+    long start_allocations;
+public:
+    Bench(const char *n, int s) : name(n), size(s), start(now_ns()), start_allocations(allocations) { }
+    void stop(long ops){
+        double ns = now_ns() - start;
+        long allocs = allocations - start_allocations;
+        printf("%-28s %8d %12.1f %10.2f\n", name, size, ns / ops, (double) allocs / ops);
+        fflush(stdout);
+    }
+};
+
+static bool wanted(const char *name){
+    return filter == NULL || strstr(name, filter) != NULL;
+}
+
+static char *numbered(const char *prefix, int i){
+    static char buf[64];
+    snprintf(buf, sizeof(buf), "%s%d", prefix, i);
+    return buf;
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// String tables
+//
+//////////////////////////////////////////////////////////////////////
+static void bench_stringtab(int n){
+    int reps = scale * (200000 / n + 1);
+    IdTable *table = new IdTable();
+    if(wanted("stringtab/intern-new")){
+        Bench b("stringtab/intern-new", n);
+        for(int i = 0; i < n; i++){
+            table->add_string(numbered("name", i));
+        }
+        b.stop(n);
+    }else{
+        for(int i = 0; i < n; i++){
+            table->add_string(numbered("name", i));
+        }
+    }
+    if(wanted("stringtab/intern-hit")){
+        Bench b("stringtab/intern-hit", n);
+        for(int r = 0; r < reps; r++){
+            sink = (long) table->add_string(numbered("name", r % n));
+        }
+        b.stop(reps);
+    }
+    if(wanted("stringtab/lookup-string")){
+        Bench b("stringtab/lookup-string", n);
+        for(int r = 0; r < reps; r++){
+            sink = (long) table->lookup_string(numbered("name", r % n));
+        }
+        b.stop(reps);
+    }
+    if(wanted("stringtab/lookup-index")){
+        Bench b("stringtab/lookup-index", n);
+        for(int r = 0; r < reps; r++){
+            sink = (long) table->lookup(r % n);
+        }
+        b.stop(reps);
+    }
+    if(wanted("stringtab/iterate")){
+        Bench b("stringtab/iterate", n);
+        long ops = 0;
+        for(int r = 0; r < reps / n + 1; r++){
+            for(int i = table->first(); table->more(i); i = table->next(i)){
+                ops++;
+            }
+        }
+        sink = ops;
+        b.stop(ops);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// SymbolTable, with `depth' scopes of `width' names each
+//
+//////////////////////////////////////////////////////////////////////
+static void bench_symtab(int depth){
+    const int width = 8;
+    int reps = scale * 200000;
+    IdTable *names = new IdTable();
+    std::vector<Symbol> syms;
+    for(int i = 0; i < depth * width + 1; i++){
+        syms.push_back(names->add_string(numbered("v", i)));
+    }
+    int value = 0;
+    SymbolTable<Symbol, int> table;
+    for(int d = 0; d < depth; d++){
+        table.enterscope();
+        for(int i = 0; i < width; i++){
+            table.addid(syms[d * width + i], &value);
+        }
+    }
+    Symbol outer = syms[0], inner = syms[depth * width - 1], missing = syms[depth * width];
+    if(wanted("symtab/addid")){
+        SymbolTable<Symbol, int> scratch = table;
+        Bench b("symtab/addid", depth);
+        for(int r = 0; r < reps; r++){
+            if(r % width == 0){
+                scratch = table;
+                scratch.enterscope();
+            }
+            scratch.addid(syms[r % width], &value);
+        }
+        b.stop(reps);
+    }
+    if(wanted("symtab/enter-exit")){
+        SymbolTable<Symbol, int> scratch = table;
+        Bench b("symtab/enter-exit", depth);
+        for(int r = 0; r < reps; r++){
+            scratch.enterscope();
+            scratch.exitscope();
+        }
+        b.stop(reps);
+    }
+    if(wanted("symtab/lookup-inner")){
+        Bench b("symtab/lookup-inner", depth);
+        for(int r = 0; r < reps; r++){
+            sink = (long) table.lookup(inner);
+        }
+        b.stop(reps);
+    }
+    if(wanted("symtab/lookup-outer")){
+        Bench b("symtab/lookup-outer", depth);
+        for(int r = 0; r < reps; r++){
+            sink = (long) table.lookup(outer);
+        }
+        b.stop(reps);
+    }
+    if(wanted("symtab/lookup-miss")){
+        Bench b("symtab/lookup-miss", depth);
+        for(int r = 0; r < reps; r++){
+            sink = (long) table.lookup(missing);
+        }
+        b.stop(reps);
+    }
+    if(wanted("symtab/probe")){
+        Bench b("symtab/probe", depth);
+        for(int r = 0; r < reps; r++){
+            sink = (long) table.probe(r % 2 ? inner : outer);
+        }
+        b.stop(reps);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// list_node, built by appending: left-deep (grown at its end, as the
+// parser builds lists), right-deep (grown at its front) and balanced
+//
+//////////////////////////////////////////////////////////////////////
+class Leaf : public tree_node {
+public:
+    tree_node *copy()                  { return new Leaf(); }
+    void dump(ostream& stream, int n)  { stream << pad(n) << "leaf\n"; }
+};
+
+typedef list_node<Leaf *> Leaves;
+
+static Leaves *build(const char *shape, int lo, int hi, std::vector<Leaf *> &leaves){
+    if(hi - lo == 0){
+        return Leaves::nil();
+    }else if(hi - lo == 1){
+        return Leaves::single(leaves[lo]);
+    }
+    Leaves *l = NULL;
+    if(strcmp(shape, "left") == 0){
+        l = Leaves::single(leaves[lo]);
+        for(int i = lo + 1; i < hi; i++){
+            l = Leaves::append(l, Leaves::single(leaves[i]));
+        }
+    }else if(strcmp(shape, "right") == 0){
+        l = Leaves::single(leaves[hi - 1]);
+        for(int i = hi - 2; i >= lo; i--){
+            l = Leaves::append(Leaves::single(leaves[i]), l);
+        }
+    }else{
+        int mid = (lo + hi) / 2;
+        l = Leaves::append(build(shape, lo, mid, leaves), build(shape, mid, hi, leaves));
+    }
+    return l;
+}
+
+static void bench_list(const char *shape, int n){
+    char name[64];
+    int reps = scale * (100000 / n + 1);
+    std::vector<Leaf *> leaves;
+    for(int i = 0; i < n; i++){
+        leaves.push_back(new Leaf());
+    }
+    snprintf(name, sizeof(name), "list/%s/build", shape);
+    Leaves *l = NULL;
+    if(wanted(name)){
+        Bench b(name, n);
+        for(int r = 0; r < reps; r++){
+            l = build(shape, 0, n, leaves);
+        }
+        b.stop((long) reps * n);
+    }else{
+        l = build(shape, 0, n, leaves);
+    }
+    snprintf(name, sizeof(name), "list/%s/len", shape);
+    if(wanted(name)){
+        Bench b(name, n);
+        for(int r = 0; r < reps; r++){
+            sink = l->len();
+        }
+        b.stop(reps);
+    }
+    //the loop every pass over a list uses
+    snprintf(name, sizeof(name), "list/%s/nth", shape);
+    if(wanted(name)){
+        Bench b(name, n);
+        long ops = 0;
+        for(int r = 0; r < reps / 100 + 1; r++){
+            for(int i = l->first(); l->more(i); i = l->next(i)){
+                sink = (long) l->nth(i);
+                ops++;
+            }
+        }
+        b.stop(ops);
+    }
+    snprintf(name, sizeof(name), "list/%s/elements", shape);
+    if(wanted(name)){
+        Bench b(name, n);
+        std::vector<Leaf *> out;
+        for(int r = 0; r < reps; r++){
+            out.clear();
+            l->elements(out);
+        }
+        sink = out.size();
+        b.stop((long) reps * n);
+    }
+}
+
+int main(int argc, char *argv[]){
+    int c;
+    while((c = getopt(argc, argv, "s:")) != -1){
+        switch(c){
+        case 's': scale = atoi(optarg) > 0 ? atoi(optarg) : 1; break;
+        default:
+            cerr << "usage: " << argv[0] << " [-s scale] [filter]\n";
+            return 1;
+        }
+    }
+    if(optind < argc){
+        filter = argv[optind];
+    }
+    printf("%-28s %8s %12s %10s\n", "benchmark", "size", "ns/op", "allocs/op");
+    int table_sizes[] = {100, 1000, 5000};
+    for(int i = 0; i < 3; i++){
+        bench_stringtab(table_sizes[i]);
+    }
+    int depths[] = {1, 8, 64};
+    for(int i = 0; i < 3; i++){
+        bench_symtab(depths[i]);
+    }
+    const char *shapes[] = {"left", "right", "balanced"};
+    int lengths[] = {10, 100, 1000};
+    for(int s = 0; s < 3; s++){
+        for(int i = 0; i < 3; i++){
+            bench_list(shapes[s], lengths[i]);
+        }
+    }
+    return 0;
+}
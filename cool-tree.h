@@ -14,8 +14,28 @@
 #include <sstream>
 #include <map>
 #include <list>
+#include <vector>
 #include "symtab.h"
 
+class SemantContext;
+class ClassTable;
+class Reachability;
+
+// Classes are numbered in preorder over the inheritance tree, so the
+// classes below one are numbered tag+1 to last.
+struct ClassTag {
+   Symbol name;
+   int tag;
+   int last;
+};
+
+// a row of a typcase branch table: objects whose class tag lies in
+// [tag, last] take branch number `branch'
+struct BranchRange {
+   int tag;
+   int last;
+   int branch;
+};
 
 // define the class for phylum
 // define simple phylum - Program
@@ -39,19 +59,22 @@ class Class__class : public tree_node {
 public:
    tree_node *copy()		 { return copy_Class_(); }
    virtual Class_ copy_Class_() = 0;
-   virtual void semant()=0;
-   virtual void initialize_contents()=0;
+   virtual void semant(SemantContext &ctx)=0;
+   virtual void initialize_contents(ClassTable *classtable)=0;
    virtual Symbol get_name()=0;
    virtual SymbolTable<Symbol, Symbol> *otable()=0;
    virtual std::map<Symbol, Feature> *mtable()=0;
    virtual Symbol get_parent()=0;
-   virtual void add_child(Class_ class_)=0;
-   virtual bool isVisited()=0;	
-   virtual void visit()=0;
-   virtual void validate_inheritanceR()=0;
+   virtual std::map<Symbol, Symbol> *flat_otable()=0;
+   virtual std::map<Symbol, Feature> *flat_mtable()=0;
+   virtual void flatten(Class_ parent)=0;
+   virtual bool isFrozen()=0;
    virtual Features getFeatures()=0;
-   virtual Symbol get_attr(Symbol s1)=0;
-   virtual Feature get_method(Symbol method)=0;
+   virtual void reuse_dump(std::string *text)=0;
+   virtual void layout_dispatch(Class_ parent)=0;
+   virtual std::vector<std::pair<Symbol, Symbol> > *dispatch_table()=0;
+   virtual int dispatch_slot(Symbol method)=0;
+   virtual void prune_methods(Reachability &r)=0;
 #ifdef Class__EXTRAS
    Class__EXTRAS
 #endif
@@ -65,12 +88,14 @@ class Feature_class : public tree_node {
 public:
    tree_node *copy()		 { return copy_Feature(); }
    virtual Feature copy_Feature() = 0;
-   virtual void semant()=0;
-   virtual void initialize(Class_ c)=0;
+   virtual void semant(SemantContext &ctx)=0;
+   virtual void initialize(Class_ c, ClassTable *classtable)=0;
    virtual Symbol get_name()=0;
    virtual bool isMethod()=0;
    virtual Symbol get_type()=0;
    virtual Formals get_formals()=0;
+   virtual void fold()=0;
+   virtual void reach(Reachability &r)=0;
 
 #ifdef Feature_EXTRAS
    Feature_EXTRAS
@@ -85,7 +110,7 @@ class Formal_class : public tree_node {
 public:
    tree_node *copy()		 { return copy_Formal(); }
    virtual Formal copy_Formal() = 0;
-   virtual void semant()=0;
+   virtual void semant(SemantContext &ctx)=0;
    virtual Symbol get_name() = 0;		
    virtual Symbol get_type() = 0;
 
@@ -102,7 +127,14 @@ class Expression_class : public tree_node {
 public:
    tree_node *copy()		 { return copy_Expression(); }
    virtual Expression copy_Expression() = 0;
-   virtual void semant()=0;
+   void semant(SemantContext &ctx);
+   void semant_iterative(SemantContext &ctx);
+   virtual Expression semant_next(SemantContext &ctx, int step)=0;
+   virtual void semant_finish(SemantContext &ctx)=0;
+   Expression fold();
+   virtual Expression *fold_next(int step)=0;
+   virtual Expression simplify() { return this; }
+   virtual void reach(Reachability &r) {}
 
 #ifdef Expression_EXTRAS
    Expression_EXTRAS
@@ -117,7 +149,9 @@ class Case_class : public tree_node {
 public:
    tree_node *copy()		 { return copy_Case(); }
    virtual Case copy_Case() = 0;
-   virtual void semant()=0;
+   virtual Expression semant_enter(SemantContext &ctx)=0;
+   virtual Symbol get_type_decl()=0;
+   virtual Expression *body_slot()=0;
 
 #ifdef Case_EXTRAS
    Case_EXTRAS
@@ -156,9 +190,11 @@ typedef Cases_class *Cases;
 class program_class : public Program_class {
 protected:
    Classes classes;
+   std::vector<ClassTag> *class_tags;
 public:
    program_class(Classes a1) {
       classes = a1;
+      class_tags = NULL;
    }
    Program copy_Program();
    void dump(ostream& stream, int n);
@@ -180,8 +216,11 @@ protected:
    Symbol filename;
    SymbolTable<Symbol, Symbol> *object_table;		
    std::map<Symbol, Feature> *method_table;
-   std::list<Class_> *child_list;
-   bool visited;
+   std::map<Symbol, Symbol> *flat_object_table;
+   std::map<Symbol, Feature> *flat_method_table;
+   std::string *typed_dump;
+   std::vector<std::pair<Symbol, Symbol> > *dispatch_layout;
+   std::map<Symbol, int> *dispatch_slots;
 public:
 
    SymbolTable<Symbol, Symbol> *otable(){return object_table;}
@@ -194,22 +233,28 @@ public:
       object_table = new SymbolTable<Symbol, Symbol>();		
       object_table->enterscope();		
       method_table = new std::map<Symbol, Feature>();
-      child_list = new std::list<Class_>();
-      visited=false;
+      flat_object_table = NULL;
+      flat_method_table = NULL;
+      typed_dump = NULL;
+      dispatch_layout = NULL;
+      dispatch_slots = NULL;
    }
    Class_ copy_Class_();
    void dump(ostream& stream, int n);
-   void semant();
-   void initialize_contents();
+   void semant(SemantContext &ctx);
+   void initialize_contents(ClassTable *classtable);
    Symbol get_name(){ return name;}
    Symbol get_parent(){ return parent;}
-   void add_child(Class_ cls){child_list->push_front(cls);}
-   bool isVisited(){ return visited;}
-   void visit(){visited = true;}
-   void validate_inheritanceR();
+   std::map<Symbol, Symbol> *flat_otable(){return flat_object_table;}
+   std::map<Symbol, Feature> *flat_mtable(){return flat_method_table;}
+   void flatten(Class_ parent);
+   bool isFrozen(){ return flat_method_table != NULL;}
    Features getFeatures(){return features;}
-   Symbol get_attr(Symbol s1);
-   Feature get_method(Symbol method);
+   void reuse_dump(std::string *text){ typed_dump = text; }
+   void layout_dispatch(Class_ parent);
+   std::vector<std::pair<Symbol, Symbol> > *dispatch_table(){ return dispatch_layout; }
+   int dispatch_slot(Symbol method);
+   void prune_methods(Reachability &r);
 
 
 #ifdef Class__SHARED_EXTRAS
@@ -237,13 +282,16 @@ public:
    }
    Feature copy_Feature();
    void dump(ostream& stream, int n);
-   void semant();
-   void initialize(Class_ c);
+   void semant(SemantContext &ctx);
+   void initialize(Class_ c, ClassTable *classtable);
    Symbol get_name(){return name;}	
    bool isMethod(){return true;}	
    Symbol get_type(){return return_type;}
    Formals get_formals(){ return formals;}
 
+   void reach(Reachability &r);
+   void fold();
+
 #ifdef Feature_SHARED_EXTRAS
    Feature_SHARED_EXTRAS
 #endif
@@ -267,13 +315,16 @@ public:
    }
    Feature copy_Feature();
    void dump(ostream& stream, int n);
-   void semant();
-   void initialize(Class_ c);
+   void semant(SemantContext &ctx);
+   void initialize(Class_ c, ClassTable *classtable);
    bool isMethod(){return false;}
    Symbol get_name(){return name;}
     Symbol get_type(){return type_decl;}
     Formals get_formals(){ return NULL;}
 
+   void reach(Reachability &r);
+   void fold();
+
 #ifdef Feature_SHARED_EXTRAS
    Feature_SHARED_EXTRAS
 #endif
@@ -295,7 +346,7 @@ public:
    }
    Formal copy_Formal();
    void dump(ostream& stream, int n);
-   void semant();
+   void semant(SemantContext &ctx);
    Symbol get_name(){return name;}		
    Symbol get_type(){return type_decl;}
 
@@ -320,9 +371,11 @@ public:
       type_decl = a2;
       expr = a3;
    }
+   Symbol get_type_decl() { return type_decl; }
+   Expression *body_slot() { return &expr; }
    Case copy_Case();
    void dump(ostream& stream, int n);
-   void semant();
+   Expression semant_enter(SemantContext &ctx);
 
 #ifdef Case_SHARED_EXTRAS
    Case_SHARED_EXTRAS
@@ -345,7 +398,9 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   void semant();
+   Expression semant_next(SemantContext &ctx, int step);
+   void semant_finish(SemantContext &ctx);
+   Expression *fold_next(int step);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -363,16 +418,25 @@ protected:
    Symbol type_name;
    Symbol name;
    Expressions actual;
+   Feature target;
+   Symbol target_class;
+   int target_slot;
 public:
    static_dispatch_class(Expression a1, Symbol a2, Symbol a3, Expressions a4) {
       expr = a1;
       type_name = a2;
       name = a3;
       actual = a4;
+      target = NULL;
+      target_class = NULL;
+      target_slot = -1;
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   void semant();
+   Expression semant_next(SemantContext &ctx, int step);
+   void semant_finish(SemantContext &ctx);
+   void reach(Reachability &r);
+   Expression *fold_next(int step);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -389,15 +453,26 @@ protected:
    Expression expr;
    Symbol name;
    Expressions actual;
+   Feature target;
+   Symbol target_class;
+   int target_slot;
+   bool monomorphic;
 public:
    dispatch_class(Expression a1, Symbol a2, Expressions a3) {
       expr = a1;
       name = a2;
       actual = a3;
+      target = NULL;
+      target_class = NULL;
+      target_slot = -1;
+      monomorphic = false;
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   void semant();
+   Expression semant_next(SemantContext &ctx, int step);
+   void semant_finish(SemantContext &ctx);
+   void reach(Reachability &r);
+   Expression *fold_next(int step);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -422,7 +497,10 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   void semant();
+   Expression semant_next(SemantContext &ctx, int step);
+   void semant_finish(SemantContext &ctx);
+   Expression *fold_next(int step);
+   Expression simplify();
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -445,7 +523,9 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   void semant();
+   Expression semant_next(SemantContext &ctx, int step);
+   void semant_finish(SemantContext &ctx);
+   Expression *fold_next(int step);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -461,14 +541,23 @@ class typcase_class : public Expression_class {
 protected:
    Expression expr;
    Cases cases;
+   std::vector<BranchRange> *branch_table;
+   std::vector<Case> *branches;
 public:
    typcase_class(Expression a1, Cases a2) {
       expr = a1;
       cases = a2;
+      branch_table = NULL;
+      branches = NULL;
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   void semant();
+   Expression semant_next(SemantContext &ctx, int step);
+   void semant_finish(SemantContext &ctx);
+   void reach(Reachability &r);
+   Expression *fold_next(int step);
+   void layout_branches(ClassTable *classtable);
+   std::vector<Case> *branch_list();
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -483,13 +572,18 @@ public:
 class block_class : public Expression_class {
 protected:
    Expressions body;
+   std::vector<Expression *> *statements;
 public:
    block_class(Expressions a1) {
       body = a1;
+      statements = NULL;
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   void semant();
+   Expression semant_next(SemantContext &ctx, int step);
+   void semant_finish(SemantContext &ctx);
+   Expression *fold_next(int step);
+   std::vector<Expression *> *statement_slots();
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -516,7 +610,10 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   void semant();
+   Expression semant_next(SemantContext &ctx, int step);
+   void semant_finish(SemantContext &ctx);
+   void reach(Reachability &r);
+   Expression *fold_next(int step);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -539,7 +636,10 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   void semant();
+   Expression semant_next(SemantContext &ctx, int step);
+   void semant_finish(SemantContext &ctx);
+   Expression *fold_next(int step);
+   Expression simplify();
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -562,7 +662,10 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   void semant();
+   Expression semant_next(SemantContext &ctx, int step);
+   void semant_finish(SemantContext &ctx);
+   Expression *fold_next(int step);
+   Expression simplify();
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -585,7 +688,10 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   void semant();
+   Expression semant_next(SemantContext &ctx, int step);
+   void semant_finish(SemantContext &ctx);
+   Expression *fold_next(int step);
+   Expression simplify();
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -608,7 +714,10 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   void semant();
+   Expression semant_next(SemantContext &ctx, int step);
+   void semant_finish(SemantContext &ctx);
+   Expression *fold_next(int step);
+   Expression simplify();
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -627,9 +736,13 @@ public:
    neg_class(Expression a1) {
       e1 = a1;
    }
+   Expression get_operand() { return e1; }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   void semant();
+   Expression semant_next(SemantContext &ctx, int step);
+   void semant_finish(SemantContext &ctx);
+   Expression *fold_next(int step);
+   Expression simplify();
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -652,7 +765,10 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   void semant();
+   Expression semant_next(SemantContext &ctx, int step);
+   void semant_finish(SemantContext &ctx);
+   Expression *fold_next(int step);
+   Expression simplify();
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -675,7 +791,10 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   void semant();
+   Expression semant_next(SemantContext &ctx, int step);
+   void semant_finish(SemantContext &ctx);
+   Expression *fold_next(int step);
+   Expression simplify();
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -698,7 +817,10 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   void semant();
+   Expression semant_next(SemantContext &ctx, int step);
+   void semant_finish(SemantContext &ctx);
+   Expression *fold_next(int step);
+   Expression simplify();
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -719,7 +841,10 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   void semant();
+   Expression semant_next(SemantContext &ctx, int step);
+   void semant_finish(SemantContext &ctx);
+   Expression *fold_next(int step);
+   Expression simplify();
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -734,13 +859,21 @@ public:
 class int_const_class : public Expression_class {
 protected:
    Symbol token;
+   long long value;   // while folding, a result that has no token yet
 public:
    int_const_class(Symbol a1) {
       token = a1;
+      value = 0;
    }
+   Symbol get_token() { return token; }
+   long long get_value();
+   void set_value(long long v) { token = NULL; value = v; }
+   void intern();
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   void semant();
+   Expression semant_next(SemantContext &ctx, int step);
+   void semant_finish(SemantContext &ctx);
+   Expression *fold_next(int step);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -759,9 +892,12 @@ public:
    bool_const_class(Boolean a1) {
       val = a1;
    }
+   Boolean get_val() { return val; }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   void semant();
+   Expression semant_next(SemantContext &ctx, int step);
+   void semant_finish(SemantContext &ctx);
+   Expression *fold_next(int step);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -780,9 +916,12 @@ public:
    string_const_class(Symbol a1) {
       token = a1;
    }
+   Symbol get_token() { return token; }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   void semant();
+   Expression semant_next(SemantContext &ctx, int step);
+   void semant_finish(SemantContext &ctx);
+   Expression *fold_next(int step);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -803,7 +942,10 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   void semant();
+   Expression semant_next(SemantContext &ctx, int step);
+   void semant_finish(SemantContext &ctx);
+   void reach(Reachability &r);
+   Expression *fold_next(int step);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -824,7 +966,9 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   void semant();
+   Expression semant_next(SemantContext &ctx, int step);
+   void semant_finish(SemantContext &ctx);
+   Expression *fold_next(int step);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -843,7 +987,9 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   void semant();
+   Expression semant_next(SemantContext &ctx, int step);
+   void semant_finish(SemantContext &ctx);
+   Expression *fold_next(int step);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -864,7 +1010,9 @@ public:
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
-   void semant();
+   Expression semant_next(SemantContext &ctx, int step);
+   void semant_finish(SemantContext &ctx);
+   Expression *fold_next(int step);
 
 #ifdef Expression_SHARED_EXTRAS
    Expression_SHARED_EXTRAS
@@ -0,0 +1,863 @@
+//
+// coolgen: writes large, well-typed COOL programs for scale testing.
+//
+//   coolgen [-A] [-p] [-s seed] [-c classes] [-d depth] [-b fanout]
+//           [-f features] [-a arity] [-e exprdepth] [-l letdepth]
+//           [-w casewidth] [-k constants] [-n filename]
+//
+// The same seed and knobs always give the same program.  By default the
+// program is written as COOL source; with -A it is written in the text
+// AST format that the parser writes and semant reads, so trees too deep
+// for the parser can still be fed to the checker.  Every feature is
+// written on its own line, so the AST of the source is the -A output.
+//
+// Every subexpression of an expression normally goes down to -e, so the
+// size of a body is exponential in its depth.  With -p only one child of
+// each expression goes on down and its siblings are leaves, so a body is
+// a spine whose size grows linearly with -e, like the long chains of +,
+// nested lets and if ladders of real programs; -e 100000 is fine.  Raise
+// -l for deep let nests.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <sstream>
+#include <iostream>
+
+// splitmix64, so that the output does not depend on the C++ library
+static unsigned long long rng_state = 1;
+
+static unsigned long long next_random(){
+    unsigned long long z = (rng_state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// a number in [0, n)
+static int pick(int n){
+    return n <= 1 ? 0 : (int) (next_random() % (unsigned long long) n);
+}
+
+static bool chance(int percent){
+    return pick(100) < percent;
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// The knobs
+//
+//////////////////////////////////////////////////////////////////////
+static int class_count = 50;      // classes besides Main
+static int max_depth = 5;         // longest chain of user classes
+static int max_fanout = 4;        // most direct subclasses of a class
+static int feature_count = 8;     // attributes and methods per class
+static int max_arity = 3;         // most formals per method
+static int expr_depth = 4;        // depth of each method body
+static int let_depth = 2;         // most lets nested on one path
+static int case_width = 4;        // branches per case
+static int constant_count = 100;  // distinct Int and String constants
+static int spine = 0;             // only one child of each expression goes deep
+static int write_ast = 0;
+static const char *filename = "generated.cl";
+
+//////////////////////////////////////////////////////////////////////
+//
+// Expressions, kept in the order of the AST format: the symbols of a
+// node, then its subexpressions.  Dispatches are the exception; the
+// receiver comes before the symbols and the arguments after them.
+//
+//////////////////////////////////////////////////////////////////////
+struct Expr {
+    std::string kind;                // the AST tag without its underscore
+    std::vector<std::string> syms;   // identifiers, types and constants
+    std::vector<Expr *> kids;
+};
+
+static Expr *node(const char *kind, Expr *a = NULL, Expr *b = NULL, Expr *c = NULL){
+    Expr *e = new Expr;
+    e->kind = kind;
+    if(a != NULL) e->kids.push_back(a);
+    if(b != NULL) e->kids.push_back(b);
+    if(c != NULL) e->kids.push_back(c);
+    return e;
+}
+
+static Expr *leaf(const char *kind, const std::string &sym){
+    Expr *e = node(kind);
+    e->syms.push_back(sym);
+    return e;
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// The class hierarchy and the signatures of every feature
+//
+//////////////////////////////////////////////////////////////////////
+struct Method {
+    std::string name;
+    std::vector<std::string> formals;   // types
+    std::string type;
+};
+
+struct ClassInfo {
+    std::string name;
+    int parent;                         // index, or -1 for Object
+    int depth;
+    std::vector<int> children;
+    std::vector<std::pair<std::string, std::string> > attrs;   // name, type
+    std::vector<Method> methods;        // defined here, overrides included
+};
+
+static std::vector<ClassInfo> classes;
+static std::map<std::string, int> class_indices;
+static std::vector<std::string> basic_types;
+static std::vector<std::string> int_constants, string_constants;
+
+static int class_index(const std::string &name){
+    std::map<std::string, int>::iterator i = class_indices.find(name);
+    return i == class_indices.end() ? -1 : i->second;
+}
+
+// the class and every class below it
+static void subtree(int c, std::vector<int> &below){
+    below.push_back(c);
+    for(size_t i = 0; i < classes[c].children.size(); i++){
+        subtree(classes[c].children[i], below);
+    }
+}
+
+// true if a value of type `sub' can be used where `super' is expected
+static bool conforms(const std::string &sub, const std::string &super){
+    if(sub == super || super == "Object"){
+        return true;
+    }
+    int super_index = class_index(super);
+    for(int c = class_index(sub); c >= 0; c = classes[c].parent){
+        if(c == super_index){
+            return true;
+        }
+    }
+    return false;
+}
+
+// every method a class has, its own first
+static std::vector<Method> methods_of(int c){
+    std::vector<Method> all;
+    std::map<std::string, bool> seen;
+    for(; c >= 0; c = classes[c].parent){
+        for(size_t i = 0; i < classes[c].methods.size(); i++){
+            if(!seen[classes[c].methods[i].name]){
+                seen[classes[c].methods[i].name] = true;
+                all.push_back(classes[c].methods[i]);
+            }
+        }
+    }
+    return all;
+}
+
+static std::string random_type(){
+    if(classes.empty() || chance(50)){
+        return basic_types[pick(basic_types.size())];
+    }
+    return classes[pick(classes.size())].name;
+}
+
+static void make_hierarchy(){
+    for(int i = 0; i < class_count; i++){
+        ClassInfo c;
+        std::ostringstream name;
+        name << "C" << i;
+        c.name = name.str();
+        c.parent = -1;
+        c.depth = 1;
+        //a few tries at a parent with room below it, else Object
+        for(int tries = 0; i > 0 && tries < 4 && chance(80); tries++){
+            int p = pick(i);
+            if(classes[p].depth < max_depth && (int) classes[p].children.size() < max_fanout){
+                c.parent = p;
+                c.depth = classes[p].depth + 1;
+                classes[p].children.push_back(i);
+                break;
+            }
+        }
+        class_indices[c.name] = i;
+        classes.push_back(c);
+    }
+    //signatures, parents first since their index is lower
+    for(int i = 0; i < class_count; i++){
+        ClassInfo &c = classes[i];
+        std::vector<Method> inherited = c.parent >= 0 ? methods_of(c.parent) : std::vector<Method>();
+        for(int j = 0; j < feature_count; j++){
+            std::ostringstream name;
+            if(j % 2 == 0){
+                name << "a" << i << "_" << j;
+                c.attrs.push_back(std::make_pair(name.str(), random_type()));
+            }else if(!inherited.empty() && chance(30)){
+                //an override keeps the signature it overrides
+                Method m = inherited[pick(inherited.size())];
+                bool again = false;
+                for(size_t k = 0; k < c.methods.size(); k++){
+                    again = again || c.methods[k].name == m.name;
+                }
+                if(!again){
+                    c.methods.push_back(m);
+                }
+            }else{
+                Method m;
+                name << "m" << i << "_" << j;
+                m.name = name.str();
+                int arity = pick(max_arity + 1);
+                for(int k = 0; k < arity; k++){
+                    m.formals.push_back(random_type());
+                }
+                m.type = random_type();
+                c.methods.push_back(m);
+            }
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// Type-directed expression generation.  gen(type, ...) returns an
+// expression whose static type conforms to `type'.
+//
+//////////////////////////////////////////////////////////////////////
+struct Scope {
+    int cls;                                                  // index, -1 for Main
+    std::vector<std::pair<std::string, std::string> > vars;   // name, type
+    std::vector<bool> assignable;
+    int lets;                                                 // lets around here
+};
+
+static int fresh = 0;
+
+static std::string fresh_name(const char *prefix){
+    std::ostringstream name;
+    name << prefix << fresh++;
+    return name.str();
+}
+
+static Expr *gen(const std::string &type, int depth, Scope &scope);
+
+// which of the `n' children of an expression carries the spine under
+// -p, or -1 if they all go deep
+static int spine_child(int n){
+    return spine ? pick(n) : -1;
+}
+
+static int child_depth(int depth, int i, int deep){
+    return deep >= 0 && i != deep ? 0 : depth - 1;
+}
+
+// the first of the variables in scope that are looked at for a use; a
+// spine nests cases and lets without bound, so under -p only the
+// innermost are
+static size_t first_visible(Scope &scope){
+    return spine && scope.vars.size() > 64 ? scope.vars.size() - 64 : 0;
+}
+
+static Expr *constant(const std::string &type){
+    if(type == "Int"){
+        return leaf("int", int_constants[pick(int_constants.size())]);
+    }else if(type == "Bool"){
+        return leaf("bool", chance(50) ? "1" : "0");
+    }else{
+        return leaf("string", string_constants[pick(string_constants.size())]);
+    }
+}
+
+// a class that conforms to `type', or -1 if none does; found by a
+// random walk down from `type' so that large hierarchies stay cheap
+static int conforming_class(const std::string &type){
+    if(type == "Object"){
+        return classes.empty() ? -1 : pick(classes.size());
+    }
+    int c = class_index(type);
+    while(c >= 0 && !classes[c].children.empty() && chance(50)){
+        c = classes[c].children[pick(classes[c].children.size())];
+    }
+    return c;
+}
+
+static Expr *gen_leaf(const std::string &type, Scope &scope){
+    std::vector<int> vars;
+    for(size_t i = first_visible(scope); i < scope.vars.size(); i++){
+        if(conforms(scope.vars[i].second, type)){
+            vars.push_back(i);
+        }
+    }
+    if(!vars.empty() && chance(50)){
+        return leaf("object", scope.vars[vars[pick(vars.size())]].first);
+    }
+    if(scope.cls >= 0 && conforms(classes[scope.cls].name, type) && chance(20)){
+        return leaf("object", "self");
+    }
+    if(type == "Int" || type == "Bool" || type == "String"){
+        return constant(type);
+    }
+    int c = conforming_class(type);
+    if(c >= 0 && (type != "Object" || chance(50))){
+        return leaf("new", classes[c].name);
+    }
+    return constant(basic_types[pick(basic_types.size())]);
+}
+
+static void add_args(Expr *call, const Method &m, int depth, Scope &scope){
+    int deep = spine_child(m.formals.size());
+    for(size_t i = 0; i < m.formals.size(); i++){
+        call->kids.push_back(gen(m.formals[i], child_depth(depth, i, deep), scope));
+    }
+}
+
+// a call of some method that returns a `type', or NULL
+static Expr *gen_dispatch(const std::string &type, int depth, Scope &scope){
+    int c = pick(classes.size() + 1) - 1;
+    if(c < 0){
+        c = scope.cls;
+    }
+    if(c < 0){
+        return NULL;
+    }
+    std::vector<Method> methods = methods_of(c);
+    std::vector<int> fits;
+    for(size_t i = 0; i < methods.size(); i++){
+        if(conforms(methods[i].type, type)){
+            fits.push_back(i);
+        }
+    }
+    if(fits.empty()){
+        return NULL;
+    }
+    const Method &m = methods[fits[pick(fits.size())]];
+    if(spine && m.formals.empty()){
+        return NULL;   //the spine would end here
+    }
+    Expr *call = node("dispatch");
+    if(c == scope.cls && chance(50)){
+        call->kids.push_back(leaf("object", "self"));
+    }else{
+        call->kids.push_back(leaf("new", classes[c].name));
+    }
+    call->syms.push_back(m.name);
+    //now and then through the class that defines it
+    if(classes[c].parent >= 0 && chance(20)){
+        int p = classes[c].parent;
+        std::vector<Method> above = methods_of(p);
+        for(size_t i = 0; i < above.size(); i++){
+            if(above[i].name == m.name){
+                call->kind = "static_dispatch";
+                call->syms.insert(call->syms.begin(), classes[p].name);
+                break;
+            }
+        }
+    }
+    add_args(call, m, depth, scope);
+    return call;
+}
+
+static Expr *gen_let(const std::string &type, int depth, Scope &scope){
+    std::string var_type = random_type();
+    Expr *e = node("let");
+    e->syms.push_back(fresh_name("v"));
+    e->syms.push_back(var_type);
+    int deep = spine_child(2);
+    e->kids.push_back(chance(20) && deep != 0 ? node("no_expr") : gen(var_type, child_depth(depth, 0, deep), scope));
+    scope.vars.push_back(std::make_pair(e->syms[0], var_type));
+    scope.assignable.push_back(true);
+    scope.lets++;
+    e->kids.push_back(gen(type, child_depth(depth, 1, deep), scope));
+    scope.lets--;
+    scope.vars.pop_back();
+    scope.assignable.pop_back();
+    return e;
+}
+
+// a case on an object of exactly type S, with branches for S and classes
+// below it, so that no branch is unreachable
+static Expr *gen_case(const std::string &type, int depth, Scope &scope){
+    int s = pick(classes.size() + 1) - 1;
+    std::vector<std::string> branch_types;
+    Expr *e = node("typcase");
+    if(s < 0){
+        Expr *wrap = node("let");
+        wrap->syms.push_back(fresh_name("v"));
+        wrap->syms.push_back("Object");
+        wrap->kids.push_back(gen("Object", spine ? 0 : depth - 1, scope));
+        wrap->kids.push_back(leaf("object", wrap->syms[0]));
+        e->kids.push_back(wrap);
+        branch_types.push_back("Object");
+        for(size_t i = 0; i < basic_types.size(); i++){
+            if(basic_types[i] != "Object"){
+                branch_types.push_back(basic_types[i]);
+            }
+        }
+        for(size_t i = 0; i < classes.size(); i++){
+            branch_types.push_back(classes[i].name);
+        }
+    }else{
+        e->kids.push_back(leaf("new", classes[s].name));
+        std::vector<int> below;
+        subtree(s, below);
+        for(size_t i = 0; i < below.size(); i++){
+            branch_types.push_back(classes[below[i]].name);
+        }
+    }
+    //S first, then a random choice of the rest
+    for(size_t i = 1; i < branch_types.size(); i++){
+        std::swap(branch_types[i], branch_types[i + pick(branch_types.size() - i)]);
+    }
+    int width = std::min((int) branch_types.size(), std::max(case_width, 1));
+    int deep = spine_child(width);
+    for(int i = 0; i < width; i++){
+        Expr *branch = node("branch");
+        branch->syms.push_back(fresh_name("c"));
+        branch->syms.push_back(branch_types[i]);
+        scope.vars.push_back(std::make_pair(branch->syms[0], branch_types[i]));
+        scope.assignable.push_back(false);
+        branch->kids.push_back(gen(type, child_depth(depth, i, deep), scope));
+        scope.vars.pop_back();
+        scope.assignable.pop_back();
+        e->kids.push_back(branch);
+    }
+    return e;
+}
+
+static Expr *gen_block(const std::string &type, int depth, Scope &scope){
+    Expr *e = node("block");
+    int n = 1 + pick(3);
+    int deep = spine_child(n);
+    for(int i = 0; i < n; i++){
+        e->kids.push_back(gen(i == n - 1 ? type : random_type(), child_depth(depth, i, deep), scope));
+    }
+    return e;
+}
+
+static Expr *gen_assign(const std::string &type, int depth, Scope &scope){
+    std::vector<int> vars;
+    for(size_t i = first_visible(scope); i < scope.vars.size(); i++){
+        if(scope.assignable[i] && conforms(scope.vars[i].second, type)){
+            vars.push_back(i);
+        }
+    }
+    if(vars.empty()){
+        return NULL;
+    }
+    std::pair<std::string, std::string> var = scope.vars[vars[pick(vars.size())]];
+    Expr *e = node("assign", gen(var.second, depth - 1, scope));
+    e->syms.push_back(var.first);
+    return e;
+}
+
+// an expression of one of the basic types, built from operators
+static Expr *gen_operator(const std::string &type, int depth, Scope &scope){
+    static const char *arith[] = {"plus", "sub", "mul", "divide"};
+    static const char *compare[] = {"lt", "leq", "eq"};
+    if(type == "Int"){
+        switch(pick(3)){
+        case 0: return node("neg", gen("Int", depth - 1, scope));
+        case 1: {
+            Expr *e = node("dispatch", gen("String", depth - 1, scope));
+            e->syms.push_back("length");
+            return e;
+        }
+        default: {
+            int deep = spine_child(2);
+            return node(arith[pick(4)], gen("Int", child_depth(depth, 0, deep), scope), gen("Int", child_depth(depth, 1, deep), scope));
+        }
+        }
+    }else if(type == "Bool"){
+        switch(pick(4)){
+        case 0: return node("comp", gen("Bool", depth - 1, scope));
+        case 1: return node("isvoid", gen(random_type(), depth - 1, scope));
+        case 2: {
+            //Int, Bool and String only compare with themselves
+            std::string t = basic_types[pick(3)];
+            int deep = spine_child(2);
+            return node("eq", gen(t, child_depth(depth, 0, deep), scope), gen(t, child_depth(depth, 1, deep), scope));
+        }
+        default: {
+            int deep = spine_child(2);
+            return node(compare[pick(2)], gen("Int", child_depth(depth, 0, deep), scope), gen("Int", child_depth(depth, 1, deep), scope));
+        }
+        }
+    }else if(type == "String"){
+        //the receiver or the first argument carries the spine
+        int deep = spine_child(2);
+        Expr *e = node("dispatch", gen("String", child_depth(depth, 0, deep), scope));
+        if(chance(50)){
+            e->syms.push_back("concat");
+            e->kids.push_back(gen("String", child_depth(depth, 1, deep), scope));
+        }else{
+            e->syms.push_back("substr");
+            e->kids.push_back(gen("Int", child_depth(depth, 1, deep), scope));
+            e->kids.push_back(gen("Int", child_depth(depth, 2, deep), scope));
+        }
+        return e;
+    }else if(type == "Object"){
+        if(chance(50)){
+            int deep = spine_child(3);
+            return node("cond", gen("Bool", child_depth(depth, 0, deep), scope), gen("Object", child_depth(depth, 1, deep), scope),
+                        gen("Object", child_depth(depth, 2, deep), scope));
+        }
+        int deep = spine_child(2);
+        return node("loop", gen("Bool", child_depth(depth, 0, deep), scope), gen("Object", child_depth(depth, 1, deep), scope));
+    }
+    return NULL;
+}
+
+static Expr *gen(const std::string &type, int depth, Scope &scope){
+    if(depth <= 0){
+        return gen_leaf(type, scope);
+    }
+    Expr *e = NULL;
+    //a spine ends at the first leaf, so it tries harder for an expression
+    for(int tries = 0; e == NULL && tries < (spine ? 100 : 4); tries++){
+        switch(pick(10)){
+        case 0: if(scope.lets < let_depth) e = gen_let(type, depth, scope); break;
+        case 1: if(case_width > 0) e = gen_case(type, depth, scope); break;
+        case 2: e = gen_block(type, depth, scope); break;
+        case 3: e = gen_assign(type, depth, scope); break;
+        case 4: case 5: e = gen_dispatch(type, depth, scope); break;
+        default: e = gen_operator(type, depth, scope); break;
+        }
+    }
+    return e != NULL ? e : gen_leaf(type, scope);
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// Writing the program.  Both writers walk the same trees.
+//
+//////////////////////////////////////////////////////////////////////
+struct Feature {
+    bool method;
+    std::string name;
+    std::vector<std::pair<std::string, std::string> > formals;
+    std::string type;
+    Expr *body;
+};
+
+struct ClassDef {
+    std::string name, parent;
+    std::vector<Feature> features;
+};
+
+//the reader ignores indentation, so past a point it stops growing; a
+//spine would otherwise make the output quadratic in its depth
+static std::string pad(int n){
+    return std::string(std::min(n, 120), ' ');
+}
+
+//the AST format: every expression has the line of its feature
+static void ast_expr(std::ostream &out, Expr *e, int line, int n){
+    if(e->kind == "no_expr"){
+        out << pad(n) << "#0\n" << pad(n) << "_no_expr\n" << pad(n) << ": _no_type\n";
+        return;
+    }
+    out << pad(n) << "#" << line << "\n" << pad(n) << "_" << e->kind << "\n";
+    bool call = e->kind == "dispatch" || e->kind == "static_dispatch";
+    size_t first = 0;
+    if(call){
+        ast_expr(out, e->kids[0], line, n + 2);
+        first = 1;
+    }
+    for(size_t i = 0; i < e->syms.size(); i++){
+        if(e->kind == "string"){
+            out << pad(n + 2) << "\"" << e->syms[i] << "\"\n";
+        }else{
+            out << pad(n + 2) << e->syms[i] << "\n";
+        }
+    }
+    if(call){
+        out << pad(n + 2) << "(\n";
+    }
+    for(size_t i = first; i < e->kids.size(); i++){
+        ast_expr(out, e->kids[i], line, n + 2);
+    }
+    if(call){
+        out << pad(n + 2) << ")\n";
+    }
+    if(e->kind != "branch"){
+        out << pad(n) << ": _no_type\n";
+    }
+}
+
+static void write_ast_program(std::ostream &out, std::vector<ClassDef> &defs){
+    int line = 1;
+    out << "#1\n_program\n";
+    for(size_t c = 0; c < defs.size(); c++){
+        out << "  #" << line << "\n  _class\n";
+        out << "    " << defs[c].name << "\n    " << defs[c].parent << "\n";
+        out << "    \"" << filename << "\"\n    (\n";
+        for(size_t i = 0; i < defs[c].features.size(); i++){
+            Feature &f = defs[c].features[i];
+            int feature_line = line + 1 + i;
+            out << "    #" << feature_line << "\n    _" << (f.method ? "method" : "attr") << "\n";
+            out << "      " << f.name << "\n";
+            for(size_t j = 0; j < f.formals.size(); j++){
+                out << "      #" << feature_line << "\n      _formal\n";
+                out << "        " << f.formals[j].first << "\n        " << f.formals[j].second << "\n";
+            }
+            out << "      " << f.type << "\n";
+            ast_expr(out, f.body, feature_line, 6);
+        }
+        out << "    )\n";
+        line += defs[c].features.size() + 2;
+    }
+}
+
+// COOL source, with every operation parenthesized
+static void source_expr(std::ostream &out, Expr *e){
+    const std::string &k = e->kind;
+    static std::map<std::string, const char *> infix;
+    if(infix.empty()){
+        infix["plus"] = " + "; infix["sub"] = " - "; infix["mul"] = " * "; infix["divide"] = " / ";
+        infix["lt"] = " < "; infix["leq"] = " <= "; infix["eq"] = " = ";
+    }
+    if(infix.count(k)){
+        out << "(";
+        source_expr(out, e->kids[0]);
+        out << infix[k];
+        source_expr(out, e->kids[1]);
+        out << ")";
+    }else if(k == "int" || k == "object"){
+        out << e->syms[0];
+    }else if(k == "string"){
+        out << "\"" << e->syms[0] << "\"";
+    }else if(k == "bool"){
+        out << (e->syms[0] == "1" ? "true" : "false");
+    }else if(k == "new"){
+        out << "(new " << e->syms[0] << ")";
+    }else if(k == "neg" || k == "comp" || k == "isvoid"){
+        out << "(" << (k == "neg" ? "~" : k == "comp" ? "not " : "isvoid ");
+        source_expr(out, e->kids[0]);
+        out << ")";
+    }else if(k == "assign"){
+        out << "(" << e->syms[0] << " <- ";
+        source_expr(out, e->kids[0]);
+        out << ")";
+    }else if(k == "dispatch" || k == "static_dispatch"){
+        source_expr(out, e->kids[0]);
+        if(k == "static_dispatch"){
+            out << "@" << e->syms[0];
+        }
+        out << "." << e->syms.back() << "(";
+        for(size_t i = 1; i < e->kids.size(); i++){
+            out << (i > 1 ? ", " : "");
+            source_expr(out, e->kids[i]);
+        }
+        out << ")";
+    }else if(k == "cond"){
+        out << "if ";
+        source_expr(out, e->kids[0]);
+        out << " then ";
+        source_expr(out, e->kids[1]);
+        out << " else ";
+        source_expr(out, e->kids[2]);
+        out << " fi";
+    }else if(k == "loop"){
+        out << "while ";
+        source_expr(out, e->kids[0]);
+        out << " loop ";
+        source_expr(out, e->kids[1]);
+        out << " pool";
+    }else if(k == "block"){
+        out << "{ ";
+        for(size_t i = 0; i < e->kids.size(); i++){
+            source_expr(out, e->kids[i]);
+            out << "; ";
+        }
+        out << "}";
+    }else if(k == "let"){
+        out << "(let " << e->syms[0] << " : " << e->syms[1];
+        if(e->kids[0]->kind != "no_expr"){
+            out << " <- ";
+            source_expr(out, e->kids[0]);
+        }
+        out << " in ";
+        source_expr(out, e->kids[1]);
+        out << ")";
+    }else if(k == "typcase"){
+        out << "case ";
+        source_expr(out, e->kids[0]);
+        out << " of ";
+        for(size_t i = 1; i < e->kids.size(); i++){
+            Expr *b = e->kids[i];
+            out << b->syms[0] << " : " << b->syms[1] << " => ";
+            source_expr(out, b->kids[0]);
+            out << "; ";
+        }
+        out << "esac";
+    }
+}
+
+static void write_source_program(std::ostream &out, std::vector<ClassDef> &defs){
+    for(size_t c = 0; c < defs.size(); c++){
+        out << "class " << defs[c].name << " inherits " << defs[c].parent << " {\n";
+        for(size_t i = 0; i < defs[c].features.size(); i++){
+            Feature &f = defs[c].features[i];
+            out << "  " << f.name;
+            if(f.method){
+                out << "(";
+                for(size_t j = 0; j < f.formals.size(); j++){
+                    out << (j > 0 ? ", " : "") << f.formals[j].first << " : " << f.formals[j].second;
+                }
+                out << ") : " << f.type << " { ";
+                source_expr(out, f.body);
+                out << " };\n";
+            }else{
+                out << " : " << f.type;
+                if(f.body->kind != "no_expr"){
+                    out << " <- ";
+                    source_expr(out, f.body);
+                }
+                out << ";\n";
+            }
+        }
+        out << "};\n";
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// The program: the classes, then a Main that calls into them
+//
+//////////////////////////////////////////////////////////////////////
+static std::vector<ClassDef> make_program(){
+    std::vector<ClassDef> defs;
+    for(size_t c = 0; c < classes.size(); c++){
+        ClassInfo &info = classes[c];
+        ClassDef def;
+        def.name = info.name;
+        def.parent = info.parent >= 0 ? classes[info.parent].name : "Object";
+        Scope scope;
+        scope.cls = c;
+        scope.lets = 0;
+        for(int a = c; a >= 0; a = classes[a].parent){
+            for(size_t i = 0; i < classes[a].attrs.size(); i++){
+                scope.vars.push_back(classes[a].attrs[i]);
+                scope.assignable.push_back(true);
+            }
+        }
+        for(size_t i = 0; i < info.attrs.size(); i++){
+            Feature f;
+            f.method = false;
+            f.name = info.attrs[i].first;
+            f.type = info.attrs[i].second;
+            f.body = chance(30) ? node("no_expr") : gen(f.type, expr_depth / 2, scope);
+            def.features.push_back(f);
+        }
+        for(size_t i = 0; i < info.methods.size(); i++){
+            Method &m = info.methods[i];
+            Feature f;
+            f.method = true;
+            f.name = m.name;
+            f.type = m.type;
+            size_t outer = scope.vars.size();
+            for(size_t j = 0; j < m.formals.size(); j++){
+                std::ostringstream name;
+                name << "p" << j;
+                f.formals.push_back(std::make_pair(name.str(), m.formals[j]));
+                scope.vars.push_back(f.formals.back());
+                scope.assignable.push_back(false);
+            }
+            f.body = gen(f.type, expr_depth, scope);
+            scope.vars.resize(outer);
+            scope.assignable.resize(outer);
+            def.features.push_back(f);
+        }
+        defs.push_back(def);
+    }
+
+    ClassDef main_def;
+    main_def.name = "Main";
+    main_def.parent = "IO";
+    Scope scope;
+    scope.cls = -1;
+    scope.lets = 0;
+    Feature main_method;
+    main_method.method = true;
+    main_method.name = "main";
+    main_method.type = "Object";
+    main_method.body = node("block");
+    for(int i = 0; i < 1 + class_count / 10; i++){
+        main_method.body->kids.push_back(gen(random_type(), expr_depth, scope));
+    }
+    main_def.features.push_back(main_method);
+    defs.push_back(main_def);
+    return defs;
+}
+
+static void make_constants(){
+    for(int i = 0; i < std::max(constant_count, 1); i++){
+        std::ostringstream n, s;
+        n << (i * 7919) % 1000003;
+        s << "s" << i;
+        if(i % 5 == 0){
+            s << "\\n";
+        }
+        int_constants.push_back(n.str());
+        string_constants.push_back(s.str());
+    }
+}
+
+static void *generate(void *){
+    basic_types.push_back("Int");
+    basic_types.push_back("Bool");
+    basic_types.push_back("String");
+    basic_types.push_back("Object");
+    make_constants();
+    make_hierarchy();
+    std::vector<ClassDef> defs = make_program();
+    if(write_ast){
+        write_ast_program(std::cout, defs);
+    }else{
+        write_source_program(std::cout, defs);
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[]){
+    int c;
+    while((c = getopt(argc, argv, "Aps:c:d:b:f:a:e:l:w:k:n:")) != -1){
+        switch(c){
+        case 'A': write_ast = 1; break;
+        case 'p': spine = 1; break;
+        case 's': rng_state = strtoull(optarg, NULL, 10); break;
+        case 'c': class_count = atoi(optarg); break;
+        case 'd': max_depth = atoi(optarg); break;
+        case 'b': max_fanout = atoi(optarg); break;
+        case 'f': feature_count = atoi(optarg); break;
+        case 'a': max_arity = atoi(optarg); break;
+        case 'e': expr_depth = atoi(optarg); break;
+        case 'l': let_depth = atoi(optarg); break;
+        case 'w': case_width = atoi(optarg); break;
+        case 'k': constant_count = atoi(optarg); break;
+        case 'n': filename = optarg; break;
+        default:
+            std::cerr << "usage: " << argv[0] << " [-A] [-p] [-s seed] [-c classes] [-d depth] [-b fanout] [-f features]"
+                 << " [-a arity] [-e exprdepth] [-l letdepth] [-w casewidth] [-k constants] [-n filename]\n";
+            return 1;
+        }
+    }
+    //generating and writing recurse once for every level of an
+    //expression, which under -p is more than the main thread's stack
+    //holds; the stack is only touched as deep as it is used
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, (8 << 20) + (size_t) std::max(expr_depth, 0) * 1024);
+    pthread_t thread;
+    if(pthread_create(&thread, &attr, generate, NULL) != 0){
+        std::cerr << argv[0] << ": cannot start the generator\n";
+        return 1;
+    }
+    pthread_join(thread, NULL);
+    return 0;
+}
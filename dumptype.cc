@@ -9,6 +9,8 @@
 #include "cool-tree.h"
 #include "utilities.h"
 
+extern int semant_annotate;   // also dump what the checker resolved
+
 // defined in stringtab.cc
 void dump_Symbol(ostream& stream, int padding, Symbol b); 
 
@@ -19,9 +21,11 @@ void dump_Boolean(ostream& stream, int padding, Boolean b);
 //
 //  dumptype.cc
 //
-//  dumptype defines a simple recursive traversal of the abstract
+//  dumptype defines a simple traversal of the abstract
 //  syntax tree (AST) that prints each node and any associated
-//  type information.  Use dump_with_types to inspect the results of
+//  type information.  Expressions are walked with an explicit stack
+//  (see Expression_class::dump_with_types below), since they can be
+//  nested far deeper than the C++ stack allows.  Use dump_with_types to inspect the results of
 //  type inference.
 //
 //  dump_with_types takes two argumenmts:
@@ -138,8 +142,17 @@ void program_class::dump_with_types(ostream& stream, int n)
 {
    dump_line(stream,n,this);
    stream << pad(n) << "_program\n";
-   for(int i = classes->first(); classes->more(i); i = classes->next(i))
-     classes->nth(i)->dump_with_types(stream, n+2);
+   std::vector<Class_> all;
+   classes->elements(all);
+   for(size_t i = 0; i < all.size(); i++)
+     all[i]->dump_with_types(stream, n+2);
+   if (semant_annotate && class_tags != NULL) {
+     stream << pad(n+2) << "_class_tags (\n";
+     for (size_t i = 0; i < class_tags->size(); i++)
+       stream << pad(n+4) << (*class_tags)[i].name << " " << (*class_tags)[i].tag
+              << " " << (*class_tags)[i].last << "\n";
+     stream << pad(n+2) << ")\n";
+   }
 }
 
 //
@@ -148,6 +161,12 @@ void program_class::dump_with_types(ostream& stream, int n)
 //
 void class__class::dump_with_types(ostream& stream, int n)
 {
+   // an incremental run that did not need to check this class again
+   // kept the dump from the run that did
+   if (typed_dump != NULL) {
+     stream << *typed_dump;
+     return;
+   }
    dump_line(stream,n,this);
    stream << pad(n) << "_class\n";
    dump_Symbol(stream, n+2, name);
@@ -158,6 +177,12 @@ void class__class::dump_with_types(ostream& stream, int n)
    for(int i = features->first(); features->more(i); i = features->next(i))
      features->nth(i)->dump_with_types(stream, n+2);
    stream << pad(n+2) << ")\n";
+   if (semant_annotate && dispatch_layout != NULL) {
+     stream << pad(n+2) << "_dispatch_table (\n";
+     for (size_t i = 0; i < dispatch_layout->size(); i++)
+       stream << pad(n+4) << (*dispatch_layout)[i].first << "." << (*dispatch_layout)[i].second << "\n";
+     stream << pad(n+2) << ")\n";
+   }
 }
 
 
@@ -206,232 +231,318 @@ void formal_class::dump_with_types(ostream& stream, int n)
 
 //
 // branch_class::dump_with_types dumps the name, type declaration,
-// and body of any case branch.
+// and body of any case branch.  dump_head prints all but the body, so
+// that typcase_class can hand the body to the expression walk below.
 //
-void branch_class::dump_with_types(ostream& stream, int n)
+void branch_class::dump_head(ostream& stream, int n)
 {
    dump_line(stream,n,this);
    stream << pad(n) << "_branch\n";
    dump_Symbol(stream, n+2, name);
    dump_Symbol(stream, n+2, type_decl);
+}
+
+void branch_class::dump_with_types(ostream& stream, int n)
+{
+   dump_head(stream, n);
    expr->dump_with_types(stream, n+2);
 }
 
 //
-// assign_class::dump_with_types prints "assign" and then (indented)
+// Expressions nest arbitrarily deep, so they are not dumped by one
+// recursive call per node.  Each kind of expression instead has a
+// dump_next(stream, n, step, at), called with step = 0, 1, 2, ..., that
+// prints whatever comes before its next subexpression and returns that
+// subexpression, or prints the rest of the node and returns NULL once
+// there are none left.  Subexpressions are printed at indentation
+// `at', which is n+2 unless dump_next says otherwise.  The walk below
+// keeps the nodes being printed on an explicit stack, much as the
+// checker's semant_next does.
+//
+struct DumpFrame {
+   Expression e;
+   int n;
+   int step;
+};
+
+void Expression_class::dump_with_types(ostream& stream, int n)
+{
+   std::vector<DumpFrame> stack;
+   DumpFrame first = { this, n, 0 };
+   stack.push_back(first);
+   while (!stack.empty()) {
+     DumpFrame &top = stack.back();
+     int at = top.n + 2;
+     Expression child = top.e->dump_next(stream, top.n, top.step++, at);
+     if (child != NULL) {
+       DumpFrame next = { child, at, 0 };
+       stack.push_back(next);
+     } else {
+       stack.pop_back();
+     }
+   }
+}
+
+//
+// assign_class::dump_next prints "assign" and then (indented)
 // the variable being assigned, the expression, and finally the type
 // of the result.  Note the call to dump_type (see above) at the
-// end of the method.
+// end.
 //
-void assign_class::dump_with_types(ostream& stream, int n)
+Expression assign_class::dump_next(ostream& stream, int n, int step, int &at)
 {
-   dump_line(stream,n,this);
-   stream << pad(n) << "_assign\n";
-   dump_Symbol(stream, n+2, name);
-   expr->dump_with_types(stream, n+2);
+   if (step == 0) {
+     dump_line(stream,n,this);
+     stream << pad(n) << "_assign\n";
+     dump_Symbol(stream, n+2, name);
+     return expr;
+   }
    dump_type(stream,n);
+   return NULL;
 }
 
 //
-// static_dispatch_class::dump_with_types prints the expression,
+// static_dispatch_class::dump_next prints the expression,
 // static dispatch class, function name, and actual arguments
 // of any static dispatch.  
 //
-void static_dispatch_class::dump_with_types(ostream& stream, int n)
-{
-   dump_line(stream,n,this);
-   stream << pad(n) << "_static_dispatch\n";
-   expr->dump_with_types(stream, n+2);
-   dump_Symbol(stream, n+2, type_name);
-   dump_Symbol(stream, n+2, name);
-   stream << pad(n+2) << "(\n";
-   for(int i = actual->first(); actual->more(i); i = actual->next(i))
-     actual->nth(i)->dump_with_types(stream, n+2);
+Expression static_dispatch_class::dump_next(ostream& stream, int n, int step, int &at)
+{
+   if (step == 0) {
+     dump_line(stream,n,this);
+     stream << pad(n) << "_static_dispatch\n";
+     return expr;
+   }
+   if (step == 1) {
+     dump_Symbol(stream, n+2, type_name);
+     dump_Symbol(stream, n+2, name);
+     stream << pad(n+2) << "(\n";
+   }
+   if (actual->more(step - 1))
+     return actual->nth(step - 1);
    stream << pad(n+2) << ")\n";
+   if (semant_annotate && target_class != NULL)
+     stream << pad(n+2) << "_target " << target_class << " " << target_slot << "\n";
    dump_type(stream,n);
+   return NULL;
 }
 
 //
-//   dispatch_class::dump_with_types is similar to 
-//   static_dispatch_class::dump_with_types 
+//   dispatch_class::dump_next is similar to 
+//   static_dispatch_class::dump_next 
 //
-void dispatch_class::dump_with_types(ostream& stream, int n)
+Expression dispatch_class::dump_next(ostream& stream, int n, int step, int &at)
 {
-   dump_line(stream,n,this);
-   stream << pad(n) << "_dispatch\n";
-   expr->dump_with_types(stream, n+2);
-   dump_Symbol(stream, n+2, name);
-   stream << pad(n+2) << "(\n";
-   for(int i = actual->first(); actual->more(i); i = actual->next(i))
-     actual->nth(i)->dump_with_types(stream, n+2);
+   if (step == 0) {
+     dump_line(stream,n,this);
+     stream << pad(n) << "_dispatch\n";
+     return expr;
+   }
+   if (step == 1) {
+     dump_Symbol(stream, n+2, name);
+     stream << pad(n+2) << "(\n";
+   }
+   if (actual->more(step - 1))
+     return actual->nth(step - 1);
    stream << pad(n+2) << ")\n";
+   if (semant_annotate && target_class != NULL)
+     stream << pad(n+2) << "_target " << target_class << " " << target_slot
+            << (monomorphic ? " monomorphic" : " polymorphic") << "\n";
    dump_type(stream,n);
+   return NULL;
 }
 
 //
-// cond_class::dump_with_types dumps each of the three expressions
+// cond_class::dump_next dumps each of the three expressions
 // in the conditional and then the type of the entire expression.
 //
-void cond_class::dump_with_types(ostream& stream, int n)
-{
-   dump_line(stream,n,this);
-   stream << pad(n) << "_cond\n";
-   pred->dump_with_types(stream, n+2);
-   then_exp->dump_with_types(stream, n+2);
-   else_exp->dump_with_types(stream, n+2);
+Expression cond_class::dump_next(ostream& stream, int n, int step, int &at)
+{
+   switch (step) {
+   case 0:
+     dump_line(stream,n,this);
+     stream << pad(n) << "_cond\n";
+     return pred;
+   case 1:
+     return then_exp;
+   case 2:
+     return else_exp;
+   }
    dump_type(stream,n);
+   return NULL;
 }
 
 //
-// loop_class::dump_with_types dumps the predicate and then the
+// loop_class::dump_next dumps the predicate and then the
 // body of the loop, and finally the type of the entire expression.
 //
-void loop_class::dump_with_types(ostream& stream, int n)
+Expression loop_class::dump_next(ostream& stream, int n, int step, int &at)
 {
-   dump_line(stream,n,this);
-   stream << pad(n) << "_loop\n";
-   pred->dump_with_types(stream, n+2);
-   body->dump_with_types(stream, n+2);
+   switch (step) {
+   case 0:
+     dump_line(stream,n,this);
+     stream << pad(n) << "_loop\n";
+     return pred;
+   case 1:
+     return body;
+   }
    dump_type(stream,n);
-}
-
-//
-//  typcase_class::dump_with_types dumps each branch of the
-//  the Case_ one at a time.  The type of the entire expression
-//  is dumped at the end.
-//
-void typcase_class::dump_with_types(ostream& stream, int n)
-{
-   dump_line(stream,n,this);
-   stream << pad(n) << "_typcase\n";
-   expr->dump_with_types(stream, n+2);
-   for(int i = cases->first(); cases->more(i); i = cases->next(i))
-     cases->nth(i)->dump_with_types(stream, n+2);
+   return NULL;
+}
+
+//
+//  typcase_class::dump_next dumps each branch of the
+//  the Case_ one at a time: the head of the branch here, and its
+//  body, two levels in, by the walk.  The type of the entire
+//  expression is dumped at the end.
+//
+Expression typcase_class::dump_next(ostream& stream, int n, int step, int &at)
+{
+   if (step == 0) {
+     dump_line(stream,n,this);
+     stream << pad(n) << "_typcase\n";
+     return expr;
+   }
+   // wide cases are common in generated code, and nth walks the list
+   std::vector<Case> *all = branch_list();
+   if ((size_t) step - 1 < all->size()) {
+     Case branch = (*all)[step - 1];
+     branch->dump_head(stream, n+2);
+     at = n+4;
+     return *branch->body_slot();
+   }
+   if (semant_annotate && branch_table != NULL) {
+     stream << pad(n+2) << "_branch_table (\n";
+     for (size_t i = 0; i < branch_table->size(); i++)
+       stream << pad(n+4) << (*branch_table)[i].tag << " " << (*branch_table)[i].last
+              << " " << (*branch_table)[i].branch << "\n";
+     stream << pad(n+2) << ")\n";
+   }
    dump_type(stream,n);
+   return NULL;
 }
 
 //
 //  The rest of the cases for Expression are very straightforward
 //  and introduce nothing that isn't already in the code discussed
-//  above.
-//
-void block_class::dump_with_types(ostream& stream, int n)
-{
-   dump_line(stream,n,this);
-   stream << pad(n) << "_block\n";
-   for(int i = body->first(); body->more(i); i = body->next(i))
-     body->nth(i)->dump_with_types(stream, n+2);
+//  above.  The arithmetic and comparison nodes differ only in
+//  their tags.
+//
+static Expression dump_operator(ostream& stream, int n, int step, Expression e,
+                                const char *tag, Expression e1, Expression e2)
+{
+   switch (step) {
+   case 0:
+     dump_line(stream,n,e);
+     stream << pad(n) << tag << "\n";
+     return e1;
+   case 1:
+     if (e2 != NULL)
+       return e2;
+   }
+   e->dump_type(stream,n);
+   return NULL;
+}
+
+Expression block_class::dump_next(ostream& stream, int n, int step, int &at)
+{
+   if (step == 0) {
+     dump_line(stream,n,this);
+     stream << pad(n) << "_block\n";
+   }
+   // long blocks are common in generated code, and nth walks the list
+   std::vector<Expression *> *all = statement_slots();
+   if ((size_t) step < all->size())
+     return *(*all)[step];
    dump_type(stream,n);
+   return NULL;
 }
 
-void let_class::dump_with_types(ostream& stream, int n)
+Expression let_class::dump_next(ostream& stream, int n, int step, int &at)
 {
-   dump_line(stream,n,this);
-   stream << pad(n) << "_let\n";
-   dump_Symbol(stream, n+2, identifier);
-   dump_Symbol(stream, n+2, type_decl);
-   init->dump_with_types(stream, n+2);
-   body->dump_with_types(stream, n+2);
+   switch (step) {
+   case 0:
+     dump_line(stream,n,this);
+     stream << pad(n) << "_let\n";
+     dump_Symbol(stream, n+2, identifier);
+     dump_Symbol(stream, n+2, type_decl);
+     return init;
+   case 1:
+     return body;
+   }
    dump_type(stream,n);
+   return NULL;
 }
 
-void plus_class::dump_with_types(ostream& stream, int n)
+Expression plus_class::dump_next(ostream& stream, int n, int step, int &at)
 {
-   dump_line(stream,n,this);
-   stream << pad(n) << "_plus\n";
-   e1->dump_with_types(stream, n+2);
-   e2->dump_with_types(stream, n+2);
-   dump_type(stream,n);
+   return dump_operator(stream, n, step, this, "_plus", e1, e2);
 }
 
-void sub_class::dump_with_types(ostream& stream, int n)
+Expression sub_class::dump_next(ostream& stream, int n, int step, int &at)
 {
-   dump_line(stream,n,this);
-   stream << pad(n) << "_sub\n";
-   e1->dump_with_types(stream, n+2);
-   e2->dump_with_types(stream, n+2);
-   dump_type(stream,n);
+   return dump_operator(stream, n, step, this, "_sub", e1, e2);
 }
 
-void mul_class::dump_with_types(ostream& stream, int n)
+Expression mul_class::dump_next(ostream& stream, int n, int step, int &at)
 {
-   dump_line(stream,n,this);
-   stream << pad(n) << "_mul\n";
-   e1->dump_with_types(stream, n+2);
-   e2->dump_with_types(stream, n+2);
-   dump_type(stream,n);
+   return dump_operator(stream, n, step, this, "_mul", e1, e2);
 }
 
-void divide_class::dump_with_types(ostream& stream, int n)
+Expression divide_class::dump_next(ostream& stream, int n, int step, int &at)
 {
-   dump_line(stream,n,this);
-   stream << pad(n) << "_divide\n";
-   e1->dump_with_types(stream, n+2);
-   e2->dump_with_types(stream, n+2);
-   dump_type(stream,n);
+   return dump_operator(stream, n, step, this, "_divide", e1, e2);
 }
 
-void neg_class::dump_with_types(ostream& stream, int n)
+Expression neg_class::dump_next(ostream& stream, int n, int step, int &at)
 {
-   dump_line(stream,n,this);
-   stream << pad(n) << "_neg\n";
-   e1->dump_with_types(stream, n+2);
-   dump_type(stream,n);
+   return dump_operator(stream, n, step, this, "_neg", e1, NULL);
 }
 
-void lt_class::dump_with_types(ostream& stream, int n)
+Expression lt_class::dump_next(ostream& stream, int n, int step, int &at)
 {
-   dump_line(stream,n,this);
-   stream << pad(n) << "_lt\n";
-   e1->dump_with_types(stream, n+2);
-   e2->dump_with_types(stream, n+2);
-   dump_type(stream,n);
+   return dump_operator(stream, n, step, this, "_lt", e1, e2);
 }
 
+Expression eq_class::dump_next(ostream& stream, int n, int step, int &at)
+{
+   return dump_operator(stream, n, step, this, "_eq", e1, e2);
+}
 
-void eq_class::dump_with_types(ostream& stream, int n)
+Expression leq_class::dump_next(ostream& stream, int n, int step, int &at)
 {
-   dump_line(stream,n,this);
-   stream << pad(n) << "_eq\n";
-   e1->dump_with_types(stream, n+2);
-   e2->dump_with_types(stream, n+2);
-   dump_type(stream,n);
+   return dump_operator(stream, n, step, this, "_leq", e1, e2);
 }
 
-void leq_class::dump_with_types(ostream& stream, int n)
+Expression comp_class::dump_next(ostream& stream, int n, int step, int &at)
 {
-   dump_line(stream,n,this);
-   stream << pad(n) << "_leq\n";
-   e1->dump_with_types(stream, n+2);
-   e2->dump_with_types(stream, n+2);
-   dump_type(stream,n);
+   return dump_operator(stream, n, step, this, "_comp", e1, NULL);
 }
 
-void comp_class::dump_with_types(ostream& stream, int n)
+Expression isvoid_class::dump_next(ostream& stream, int n, int step, int &at)
 {
-   dump_line(stream,n,this);
-   stream << pad(n) << "_comp\n";
-   e1->dump_with_types(stream, n+2);
-   dump_type(stream,n);
+   return dump_operator(stream, n, step, this, "_isvoid", e1, NULL);
 }
 
-void int_const_class::dump_with_types(ostream& stream, int n)
+Expression int_const_class::dump_next(ostream& stream, int n, int step, int &at)
 {
    dump_line(stream,n,this);
    stream << pad(n) << "_int\n";
    dump_Symbol(stream, n+2, token);
    dump_type(stream,n);
+   return NULL;
 }
 
-void bool_const_class::dump_with_types(ostream& stream, int n)
+Expression bool_const_class::dump_next(ostream& stream, int n, int step, int &at)
 {
    dump_line(stream,n,this);
    stream << pad(n) << "_bool\n";
    dump_Boolean(stream, n+2, val);
    dump_type(stream,n);
+   return NULL;
 }
 
-void string_const_class::dump_with_types(ostream& stream, int n)
+Expression string_const_class::dump_next(ostream& stream, int n, int step, int &at)
 {
    dump_line(stream,n,this);
    stream << pad(n) << "_string\n";
@@ -439,36 +550,31 @@ void string_const_class::dump_with_types(ostream& stream, int n)
    print_escaped_string(stream,token->get_string());
    stream << "\"\n";
    dump_type(stream,n);
+   return NULL;
 }
 
-void new__class::dump_with_types(ostream& stream, int n)
+Expression new__class::dump_next(ostream& stream, int n, int step, int &at)
 {
    dump_line(stream,n,this);
    stream << pad(n) << "_new\n";
    dump_Symbol(stream, n+2, type_name);
    dump_type(stream,n);
+   return NULL;
 }
 
-void isvoid_class::dump_with_types(ostream& stream, int n)
-{
-   dump_line(stream,n,this);
-   stream << pad(n) << "_isvoid\n";
-   e1->dump_with_types(stream, n+2);
-   dump_type(stream,n);
-}
-
-void no_expr_class::dump_with_types(ostream& stream, int n)
+Expression no_expr_class::dump_next(ostream& stream, int n, int step, int &at)
 {
    dump_line(stream,n,this);
    stream << pad(n) << "_no_expr\n";
    dump_type(stream,n);
+   return NULL;
 }
 
-void object_class::dump_with_types(ostream& stream, int n)
+Expression object_class::dump_next(ostream& stream, int n, int step, int &at)
 {
    dump_line(stream,n,this);
    stream << pad(n) << "_object\n";
    dump_Symbol(stream, n+2, name);
    dump_type(stream,n);
+   return NULL;
 }
-
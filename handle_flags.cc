@@ -8,6 +8,7 @@
 #include <stdlib.h>
 #include "cool-io.h"
 #include <unistd.h>
+#include <thread>
 #include "cgen_gc.h"
 
 //
@@ -26,6 +27,18 @@ extern int yy_flex_debug;       // for the lexer; prints recognized rules
 extern int cool_yydebug;        // for the parser
        int lex_verbose;         // also for the lexer; prints tokens
        int semant_debug;        // for semantic analysis
+       int semant_memoize;      // remember the result of each conformance check
+       int semant_parallel;     // number of type checking threads; 0 checks on the main thread
+       int semant_iterative_depth; // parse depth above which expressions are checked without recursion
+       int semant_json_diagnostics; // write semantic errors as JSON lines
+       char *semant_incremental_state; // state file for incremental checking, or NULL
+       int semant_annotate;     // add resolved dispatch targets and layouts to the dump
+       int semant_prune;        // leave out classes and methods Main.main cannot reach
+       int semant_stats;        // report phase times and checker counters
+       int semant_alloc_stats;  // count allocations by subsystem and report peak RSS
+       char *semant_trace_file; // where to write a trace of the phases, classes and methods, or NULL
+       char *semant_cache_dir;  // directory of cached runs, or NULL
+       long semant_cache_megabytes; // size bound for that directory
        int cgen_debug;          // for code gen
        bool disable_reg_alloc;  // Don't do register allocation
 
@@ -48,12 +61,24 @@ void handle_flags(int argc, char *argv[]) {
   cool_yydebug = 0;
   lex_verbose  = 0;
   semant_debug = 0;
+  semant_memoize = 0;
+  semant_parallel = 0;
+  semant_iterative_depth = 2000;
+  semant_json_diagnostics = 0;
+  semant_incremental_state = NULL;
+  semant_cache_dir = NULL;
+  semant_annotate = 0;
+  semant_prune = 0;
+  semant_stats = 0;
+  semant_trace_file = NULL;
+  semant_alloc_stats = 0;
+  semant_cache_megabytes = 256;
   cgen_debug = 0;
   cgen_optimize = 0;
   disable_reg_alloc = 0;
   
 
-  while ((c = getopt(argc, argv, "lpscvrOo:gtT")) != -1) {
+  while ((c = getopt(argc, argv, "lpscvrOo:gtTmPJADSMj:i:I:C:z:E:")) != -1) {
     switch (c) {
 #ifdef DEBUG
     case 'l':
@@ -99,6 +124,47 @@ void handle_flags(int argc, char *argv[]) {
     case 'O':  // enable optimization
       cgen_optimize = 1;
       break;
+    case 'm':  // memoize conformance checks in the semantic analyzer
+      semant_memoize = 1;
+      break;
+    case 'P':  // type check in parallel, one thread per core
+      semant_parallel = std::thread::hardware_concurrency();
+      if (semant_parallel < 2) semant_parallel = 2;
+      break;
+    case 'j':  // type check in parallel on this many threads
+      semant_parallel = atoi(optarg);
+      if (semant_parallel < 0) semant_parallel = 0;
+      break;
+    case 'J':  // semantic errors as JSON lines, for tools
+      semant_json_diagnostics = 1;
+      break;
+    case 'I':  // only check the classes changed since the run that wrote this file
+      semant_incremental_state = optarg;
+      break;
+    case 'A':  // annotate the typed AST for code generation
+      semant_annotate = 1;
+      break;
+    case 'D':  // remove dead classes and methods from the typed AST
+      semant_prune = 1;
+      break;
+    case 'S':  // time the phases of semantic analysis and count its work
+      semant_stats = 1;
+      break;
+    case 'M':  // count allocations by subsystem
+      semant_alloc_stats = 1;
+      break;
+    case 'E':  // write a Chrome trace_event file of the checking
+      semant_trace_file = optarg;
+      break;
+    case 'C':  // reuse the output of earlier runs on the same input
+      semant_cache_dir = optarg;
+      break;
+    case 'z':  // keep the cache directory under this many megabytes
+      semant_cache_megabytes = atol(optarg);
+      break;
+    case 'i':  // check expressions iteratively past this parse depth; 0 always does
+      semant_iterative_depth = atoi(optarg);
+      break;
     case '?':
       unknownopt = 1;
       break;
@@ -111,9 +177,9 @@ void handle_flags(int argc, char *argv[]) {
   if (unknownopt) {
       cerr << "usage: " << argv[0] << 
 #ifdef DEBUG
-	  " [-lvpscOgtTr -o outname] [input-files]\n";
+	  " [-lvpscOgtTrmPJADSM -j threads -i depth -I statefile -C cachedir -z megabytes -E tracefile -o outname] [input-files]\n";
 #else
-      " [-OgtT -o outname] [input-files]\n";
+      " [-OgtTmPJADSM -j threads -i depth -I statefile -C cachedir -z megabytes -E tracefile -o outname] [input-files]\n";
 #endif
       exit(1);
   }
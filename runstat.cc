@@ -0,0 +1,104 @@
+//
+// runstat: runs a command and reports what it cost.
+//
+//   runstat command [args...]
+//
+// The command reads runstat's standard input.  Its standard output and
+// standard error are counted and thrown away, and one line is written:
+//
+//   wall_ms user_ms sys_ms maxrss_kb out_bytes err_bytes status
+//
+// The times and the peak resident set come from wait4, so they cover
+// the command alone.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+static double ms(const struct timeval &t){
+    return t.tv_sec * 1e3 + t.tv_usec / 1e3;
+}
+
+static double now_ms(){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+int main(int argc, char *argv[]){
+    if(argc < 2){
+        fprintf(stderr, "usage: %s command [args...]\n", argv[0]);
+        return 2;
+    }
+    int out[2], err[2];
+    if(pipe(out) != 0 || pipe(err) != 0){
+        perror("runstat: pipe");
+        return 2;
+    }
+    double start = now_ms();
+    pid_t pid = fork();
+    if(pid < 0){
+        perror("runstat: fork");
+        return 2;
+    }
+    if(pid == 0){
+        dup2(out[1], 1);
+        dup2(err[1], 2);
+        close(out[0]); close(out[1]);
+        close(err[0]); close(err[1]);
+        execvp(argv[1], argv + 1);
+        perror(argv[1]);
+        _exit(127);
+    }
+    close(out[1]);
+    close(err[1]);
+
+    //drain both pipes until the command closes them
+    struct pollfd fds[2] = {{out[0], POLLIN, 0}, {err[0], POLLIN, 0}};
+    long bytes[2] = {0, 0};
+    int open_pipes = 2;
+    char buf[65536];
+    while(open_pipes > 0){
+        if(poll(fds, 2, -1) < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            perror("runstat: poll");
+            return 2;
+        }
+        for(int i = 0; i < 2; i++){
+            if(fds[i].fd < 0 || fds[i].revents == 0){
+                continue;
+            }
+            ssize_t n = read(fds[i].fd, buf, sizeof(buf));
+            if(n > 0){
+                bytes[i] += n;
+            }else if(n == 0 || errno != EINTR){
+                close(fds[i].fd);
+                fds[i].fd = -1;
+                open_pipes--;
+            }
+        }
+    }
+
+    int status;
+    struct rusage usage;
+    while(wait4(pid, &status, 0, &usage) < 0){
+        if(errno != EINTR){
+            perror("runstat: wait4");
+            return 2;
+        }
+    }
+    double wall = now_ms() - start;
+    int code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    printf("%.2f %.2f %.2f %ld %ld %ld %d\n", wall, ms(usage.ru_utime), ms(usage.ru_stime),
+           usage.ru_maxrss, bytes[0], bytes[1], code);
+    return 0;
+}
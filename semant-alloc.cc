@@ -0,0 +1,71 @@
+//
+// The counting operator new and the -M report; see semant-alloc.h.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include <atomic>
+#include <sys/resource.h>
+#include "cool-io.h"
+#include "semant-alloc.h"
+
+extern int semant_alloc_stats;
+
+static std::atomic<long> alloc_count[ALLOC_CATEGORIES];
+static std::atomic<long> alloc_bytes[ALLOC_CATEGORIES];
+
+static const char *category_names[ALLOC_CATEGORIES] = {
+    "other", "AST", "string tables", "symbol tables", "class tables", "checker", "diagnostics"
+};
+
+void *operator new(size_t size){
+    if(semant_alloc_stats){
+        alloc_count[alloc_category].fetch_add(1, std::memory_order_relaxed);
+        alloc_bytes[alloc_category].fetch_add(size, std::memory_order_relaxed);
+    }
+    void *p = malloc(size == 0 ? 1 : size);
+    if(p == NULL){
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void *operator new[](size_t size){
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept{
+    free(p);
+}
+
+void operator delete[](void *p) noexcept{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept{
+    free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept{
+    free(p);
+}
+
+void alloc_report(ostream &out){
+    char line[128];
+    long count = 0, bytes = 0;
+    out << "allocations:" << endl;
+    snprintf(line, sizeof(line), "  %12s %14s  %s", "count", "bytes", "category");
+    out << line << endl;
+    for(int c = 0; c < ALLOC_CATEGORIES; c++){
+        snprintf(line, sizeof(line), "  %12ld %14ld  %s", alloc_count[c].load(), alloc_bytes[c].load(), category_names[c]);
+        out << line << endl;
+        count += alloc_count[c];
+        bytes += alloc_bytes[c];
+    }
+    snprintf(line, sizeof(line), "  %12ld %14ld  total", count, bytes);
+    out << line << endl;
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    out << "peak RSS: " << usage.ru_maxrss << " KB" << endl;
+}
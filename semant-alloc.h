@@ -0,0 +1,40 @@
+#ifndef SEMANT_ALLOC_H_
+#define SEMANT_ALLOC_H_
+
+#include "cool-io.h"
+
+// Allocation accounting for -M.  semant replaces the global operator
+// new; while -M is on, every allocation is charged to the category of
+// the thread that makes it.  The category is set for a stretch of code
+// with an AllocScope, and the innermost scope wins, so the strings the
+// AST reader interns count as string tables, not as AST.
+//
+// Only semant links the accounting; other programs that include this
+// header just set a thread-local that nothing reads.
+
+enum AllocCategory {
+  ALLOC_OTHER,
+  ALLOC_AST,          // tree nodes and lists, read or rewritten
+  ALLOC_STRINGS,      // string table entries
+  ALLOC_SYMBOLS,      // scopes and the symbols bound in them
+  ALLOC_CLASSES,      // the class table and everything it records
+  ALLOC_CHECKER,      // the rest of type checking
+  ALLOC_DIAGNOSTICS,  // error and warning records
+  ALLOC_CATEGORIES
+};
+
+inline thread_local int alloc_category = ALLOC_OTHER;
+
+class AllocScope {
+private:
+  int saved;
+public:
+  AllocScope(int category) : saved(alloc_category) { alloc_category = category; }
+  ~AllocScope() { alloc_category = saved; }
+  // switches category without leaving the scope, for consecutive phases
+  void set(int category) { alloc_category = category; }
+};
+
+void alloc_report(ostream &out);
+
+#endif
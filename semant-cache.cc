@@ -0,0 +1,204 @@
+//
+// The on-disk cache of semant runs; see semant-cache.h.
+//
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include "cool-io.h"
+#include "semant-cache.h"
+
+#define CACHE_VERSION "semant-cache 1"
+
+//////////////////////////////////////////////////////////////////////
+//
+// SHA-256 (FIPS 180-4)
+//
+//////////////////////////////////////////////////////////////////////
+static const unsigned int sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline unsigned int rotr(unsigned int x, int n){
+    return (x >> n) | (x << (32 - n));
+}
+
+static void sha256_block(unsigned int h[8], const unsigned char *p){
+    unsigned int w[64];
+    for(int i = 0; i < 16; i++){
+        w[i] = (p[4*i] << 24) | (p[4*i+1] << 16) | (p[4*i+2] << 8) | p[4*i+3];
+    }
+    for(int i = 16; i < 64; i++){
+        unsigned int s0 = rotr(w[i-15], 7) ^ rotr(w[i-15], 18) ^ (w[i-15] >> 3);
+        unsigned int s1 = rotr(w[i-2], 17) ^ rotr(w[i-2], 19) ^ (w[i-2] >> 10);
+        w[i] = w[i-16] + s0 + w[i-7] + s1;
+    }
+    unsigned int a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], hh = h[7];
+    for(int i = 0; i < 64; i++){
+        unsigned int t1 = hh + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        unsigned int t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        hh = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+}
+
+//the digest of `data', as 64 hex digits
+static std::string sha256(const std::string &data){
+    unsigned int h[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    size_t n = data.size();
+    const unsigned char *p = (const unsigned char *) data.data();
+    size_t full = n - n % 64;
+    for(size_t i = 0; i < full; i += 64){
+        sha256_block(h, p + i);
+    }
+    //the rest, a one bit, zeros and the length in bits
+    unsigned char tail[128];
+    size_t rest = n - full;
+    memset(tail, 0, sizeof(tail));
+    memcpy(tail, p + full, rest);
+    tail[rest] = 0x80;
+    size_t tail_len = rest < 56 ? 64 : 128;
+    unsigned long long bits = (unsigned long long) n * 8;
+    for(int i = 0; i < 8; i++){
+        tail[tail_len - 1 - i] = (unsigned char) (bits >> (8 * i));
+    }
+    for(size_t i = 0; i < tail_len; i += 64){
+        sha256_block(h, tail + i);
+    }
+    char hex[65];
+    for(int i = 0; i < 8; i++){
+        snprintf(hex + 8 * i, 9, "%08x", h[i]);
+    }
+    return std::string(hex, 64);
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// The cache
+//
+//////////////////////////////////////////////////////////////////////
+
+//Identifies the semant binary.  Rebuilding it changes the size, the
+//modification time or the inode, so old entries stop matching.
+static std::string build_id(){
+    struct stat st;
+    std::ostringstream id;
+    if(stat("/proc/self/exe", &st) == 0){
+        id << st.st_dev << ":" << st.st_ino << ":" << st.st_size << ":" << st.st_mtime;
+    }else{
+        id << __DATE__ << " " << __TIME__;
+    }
+    return id.str();
+}
+
+std::string semant_cache_key(const std::string &input, const std::string &options){
+    std::string keyed = CACHE_VERSION;
+    keyed += '\0';
+    keyed += build_id();
+    keyed += '\0';
+    keyed += options;
+    keyed += '\0';
+    keyed += input;
+    return sha256(keyed);
+}
+
+static std::string entry_path(const char *dir, const std::string &key){
+    return std::string(dir) + "/" + key;
+}
+
+//Writes out a stored run and marks the entry as just used.  Anything
+//that does not look like a complete entry is a miss.
+bool semant_cache_fetch(const char *dir, const std::string &key){
+    std::string path = entry_path(dir, key);
+    std::ifstream in(path.c_str(), std::ios::binary);
+    std::string version;
+    size_t out_len, err_len;
+    if(!std::getline(in, version) || version != CACHE_VERSION || !(in >> out_len >> err_len) || in.get() != '\n'){
+        return false;
+    }
+    std::string out(out_len, '\0'), err(err_len, '\0');
+    if((out_len && !in.read(&out[0], out_len)) || (err_len && !in.read(&err[0], err_len))){
+        return false;
+    }
+    utime(path.c_str(), NULL);
+    cerr.write(err.data(), err.size());
+    cerr.flush();
+    cout.write(out.data(), out.size());
+    cout.flush();
+    return true;
+}
+
+struct CacheFile {
+    std::string path;
+    time_t used;
+    long size;
+};
+
+static bool used_earlier(const CacheFile &a, const CacheFile &b){
+    return a.used < b.used;
+}
+
+//removes the least recently used entries until the directory fits
+static void evict(const char *dir, long max_bytes){
+    DIR *d = opendir(dir);
+    if(d == NULL){
+        return;
+    }
+    std::vector<CacheFile> files;
+    long total = 0;
+    struct dirent *e;
+    while((e = readdir(d)) != NULL){
+        CacheFile f;
+        f.path = std::string(dir) + "/" + e->d_name;
+        struct stat st;
+        if(e->d_name[0] == '.' || stat(f.path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)){
+            continue;
+        }
+        f.used = st.st_mtime;
+        f.size = st.st_size;
+        total += f.size;
+        files.push_back(f);
+    }
+    closedir(d);
+    std::sort(files.begin(), files.end(), used_earlier);
+    for(size_t i = 0; i < files.size() && total > max_bytes; i++){
+        if(unlink(files[i].path.c_str()) == 0){
+            total -= files[i].size;
+        }
+    }
+}
+
+//Entries are written under a temporary name and renamed into place, so
+//concurrent runs never see half an entry.
+void semant_cache_store(const char *dir, const std::string &key, const std::string &out,
+                        const std::string &err, long max_bytes){
+    mkdir(dir, 0777);
+    std::ostringstream tmp;
+    tmp << dir << "/." << key << "." << getpid();
+    std::ofstream file(tmp.str().c_str(), std::ios::binary);
+    file << CACHE_VERSION << "\n" << out.size() << " " << err.size() << "\n";
+    file.write(out.data(), out.size());
+    file.write(err.data(), err.size());
+    file.close();
+    if(!file || rename(tmp.str().c_str(), entry_path(dir, key).c_str()) != 0){
+        unlink(tmp.str().c_str());
+        return;
+    }
+    evict(dir, max_bytes);
+}
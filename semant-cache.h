@@ -0,0 +1,17 @@
+#ifndef SEMANT_CACHE_H_
+#define SEMANT_CACHE_H_
+
+#include <string>
+
+// An on-disk cache of whole semant runs.  Each entry holds what one run
+// wrote to standard output and standard error, and is named by the
+// SHA-256 of the input AST, the options and the identity of the semant
+// binary.  Entries are touched when they are used and the least recently
+// used ones are removed once the directory grows past its size bound.
+
+std::string semant_cache_key(const std::string &input, const std::string &options);
+bool semant_cache_fetch(const char *dir, const std::string &key);
+void semant_cache_store(const char *dir, const std::string &key, const std::string &out,
+                        const std::string &err, long max_bytes);
+
+#endif
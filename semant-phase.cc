@@ -1,5 +1,11 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sstream>
 #include "cool-tree.h"
+#include "semant-cache.h"
+#include "semant-stats.h"
+#include "semant-alloc.h"
 
 extern Program ast_root;      // root of the abstract syntax tree
 FILE *ast_file = stdin;       // we read the AST from standard input
@@ -8,12 +14,82 @@ extern int ast_yyparse(void); // entry point to the AST parser
 int cool_yydebug;     // not used, but needed to link with handle_flags
 char *curr_filename;
 
+extern int semant_debug;
+extern int semant_stats;
+extern char *semant_trace_file;
+extern int semant_alloc_stats;
+extern char *semant_cache_dir;
+extern long semant_cache_megabytes;
+
 void handle_flags(int argc, char *argv[]);
 
+//the options that can change the output, for the cache key
+static std::string output_options(int argc, char *argv[]) {
+  std::string options;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-C") == 0 || strcmp(argv[i], "-z") == 0) {
+      i++;
+      continue;
+    }
+    options += argv[i];
+    options += ' ';
+  }
+  return options;
+}
+
 int main(int argc, char *argv[]) {
+  std::string options = output_options(argc, argv);
   handle_flags(argc,argv);
-  ast_yyparse();
+  if (semant_trace_file != NULL) {
+    atexit(trace_write);
+  }
+
+  // neither debugging output nor measurements are worth keeping
+  if (semant_cache_dir == NULL || semant_debug || semant_stats || semant_trace_file != NULL
+      || semant_alloc_stats) {
+    PhaseClock phase;
+    phase.begin("read AST");
+    {
+      AllocScope alloc(ALLOC_AST);
+      ast_yyparse();
+    }
+    phase.stop();
+    ast_root->semant();
+    phase.begin("dump_with_types");
+    ast_root->dump_with_types(cout,0);
+    cout.flush();
+    phase.stop();
+    if (semant_stats) {
+      stats_report(cerr);
+    }
+    return 0;
+  }
+
+  // the input is read whole so that it can be hashed, then parsed from memory
+  std::string input;
+  char buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), stdin)) > 0) {
+    input.append(buf, n);
+  }
+  std::string key = semant_cache_key(input, options);
+  if (semant_cache_fetch(semant_cache_dir, key)) {
+    return 0;
+  }
+  if (!input.empty()) {
+    ast_file = fmemopen((void *) input.data(), input.size(), "r");
+  }
+  {
+    AllocScope alloc(ALLOC_AST);
+    ast_yyparse();
+  }
+
+  std::ostringstream out, err;
+  std::streambuf *saved = cerr.rdbuf(err.rdbuf());
   ast_root->semant();
-  ast_root->dump_with_types(cout,0);
+  cerr.rdbuf(saved);
+  ast_root->dump_with_types(out,0);
+  cerr << err.str();
+  cout << out.str();
+  semant_cache_store(semant_cache_dir, key, out.str(), err.str(), semant_cache_megabytes << 20);
 }
-
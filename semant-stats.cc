@@ -0,0 +1,216 @@
+//
+// The -S report and the -E trace; see semant-stats.h.
+//
+#include <stdio.h>
+#include <time.h>
+#include <string.h>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <fstream>
+#include <algorithm>
+#include "semant-stats.h"
+
+extern int semant_stats;
+extern char *semant_trace_file;
+
+#define SLOWEST_CLASSES 10
+
+static std::vector<std::pair<const char *, double> > phases;   // in the order first seen
+static std::map<Symbol, double> class_ms;
+static std::mutex class_lock;   // classes are timed on the checking threads
+static SemantCounters counters;
+
+double stats_now_ms(){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// The trace
+//
+//////////////////////////////////////////////////////////////////////
+struct TraceEvent {
+    std::string name;
+    const char *category;
+    double start, end;   // ms
+    int thread;
+};
+
+static std::vector<TraceEvent> trace;
+static std::mutex trace_lock;
+static std::atomic<int> trace_threads(0);
+static double trace_origin = stats_now_ms();
+
+//threads are numbered in the order they first record an event, so the
+//main thread, which times the first phase, is thread 0
+static int trace_thread(){
+    static thread_local int thread = -1;
+    if(thread < 0){
+        thread = trace_threads++;
+    }
+    return thread;
+}
+
+static void trace_event(const std::string &name, const char *category, double start, double end){
+    TraceEvent e;
+    e.name = name;
+    e.category = category;
+    e.start = start;
+    e.end = end;
+    e.thread = trace_thread();
+    std::lock_guard<std::mutex> guard(trace_lock);
+    trace.push_back(e);
+}
+
+TraceSpan::TraceSpan(Symbol c, Symbol m) : cls(c), method(m), start(0){
+    if(semant_trace_file != NULL){
+        start = stats_now_ms();
+    }
+}
+
+TraceSpan::~TraceSpan(){
+    if(semant_trace_file == NULL){
+        return;
+    }
+    std::string name(cls->get_string(), cls->get_len());
+    if(method != NULL){
+        name += ".";
+        name.append(method->get_string(), method->get_len());
+    }
+    trace_event(name, method != NULL ? "method" : "class", start, stats_now_ms());
+}
+
+//a class span for checking that did not happen in one scope
+void trace_add_class(Symbol name, double start, double end){
+    trace_event(std::string(name->get_string(), name->get_len()), "class", start, end);
+}
+
+static void json_string(ostream &out, const std::string &s){
+    out << '"';
+    for(size_t i = 0; i < s.size(); i++){
+        unsigned char c = s[i];
+        if(c == '"' || c == '\\'){
+            out << '\\' << c;
+        }else if(c < 0x20){
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out << buf;
+        }else{
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+//microseconds since the program started, as the format wants
+static void json_time(ostream &out, double ms){
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.3f", ms * 1e3);
+    out << buf;
+}
+
+void trace_write(){
+    if(semant_trace_file == NULL){
+        return;
+    }
+    std::ofstream out(semant_trace_file);
+    if(!out){
+        cerr << "cannot write the trace to " << semant_trace_file << endl;
+        return;
+    }
+    std::lock_guard<std::mutex> guard(trace_lock);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"semant\"}}";
+    for(int t = 0; t < trace_threads; t++){
+        out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << t
+            << ",\"args\":{\"name\":\"" << (t == 0 ? "main" : "checker") << " " << t << "\"}}";
+    }
+    for(size_t i = 0; i < trace.size(); i++){
+        out << ",\n{\"name\":";
+        json_string(out, trace[i].name);
+        out << ",\"cat\":\"" << trace[i].category << "\",\"ph\":\"X\",\"ts\":";
+        json_time(out, trace[i].start - trace_origin);
+        out << ",\"dur\":";
+        json_time(out, trace[i].end - trace[i].start);
+        out << ",\"pid\":1,\"tid\":" << trace[i].thread << "}";
+    }
+    out << "\n]}\n";
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// Phases and the report
+//
+//////////////////////////////////////////////////////////////////////
+void PhaseClock::begin(const char *name){
+    stop();
+    if(semant_stats || semant_trace_file != NULL){
+        phase = name;
+        start = stats_now_ms();
+    }
+}
+
+void PhaseClock::stop(){
+    if(phase == NULL){
+        return;
+    }
+    double end = stats_now_ms();
+    if(semant_trace_file != NULL){
+        trace_event(phase, "phase", start, end);
+    }
+    double ms = end - start;
+    size_t i = 0;
+    while(i < phases.size() && strcmp(phases[i].first, phase) != 0){
+        i++;
+    }
+    if(i == phases.size()){
+        phases.push_back(std::make_pair(phase, 0.0));
+    }
+    phases[i].second += ms;
+    phase = NULL;
+}
+
+void stats_add_class(Symbol name, double ms){
+    std::lock_guard<std::mutex> guard(class_lock);
+    class_ms[name] += ms;
+}
+
+void stats_add_counters(const SemantCounters &c){
+    counters.add(c);
+}
+
+static bool slower(const std::pair<Symbol, double> &a, const std::pair<Symbol, double> &b){
+    return a.second > b.second;
+}
+
+void stats_report(ostream &out){
+    char line[128];
+    double total = 0;
+    out << "phases (ms):" << endl;
+    for(size_t i = 0; i < phases.size(); i++){
+        snprintf(line, sizeof(line), "  %10.2f  %s", phases[i].second, phases[i].first);
+        out << line << endl;
+        total += phases[i].second;
+    }
+    snprintf(line, sizeof(line), "  %10.2f  total", total);
+    out << line << endl;
+
+    std::vector<std::pair<Symbol, double> > slowest(class_ms.begin(), class_ms.end());
+    std::sort(slowest.begin(), slowest.end(), slower);
+    out << "slowest classes (ms), of " << slowest.size() << " checked:" << endl;
+    for(size_t i = 0; i < slowest.size() && i < SLOWEST_CLASSES; i++){
+        snprintf(line, sizeof(line), "  %10.2f  ", slowest[i].second);
+        out << line << slowest[i].first << endl;
+    }
+
+    out << "counters:" << endl;
+    snprintf(line, sizeof(line), "  %10ld  symbol lookups\n  %10ld  inherits calls\n"
+             "  %10ld  scopes entered\n  %10ld  nodes visited",
+             counters.lookups, counters.inherits, counters.scopes, counters.nodes);
+    out << line << endl;
+}
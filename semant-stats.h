@@ -0,0 +1,66 @@
+#ifndef SEMANT_STATS_H_
+#define SEMANT_STATS_H_
+
+#include "cool-io.h"
+#include "stringtab.h"
+
+// The timing and counter report written to standard error under -S,
+// and the trace written under -E.  Phases are timed with a PhaseClock,
+// classes as they are checked, and the counters are kept per
+// SemantContext and added up at the end.  Nothing is timed without -S
+// or -E.
+//
+// The trace is in the Chrome trace_event format, for chrome://tracing
+// or Perfetto: one complete event per phase, per class and per method,
+// on the thread that ran it.  Under -j the features of a class may be
+// checked on several threads, and the class gets a span on each of them
+// for every run of its features checked there.  Events are kept in
+// memory and written when the program exits.
+
+struct SemantCounters {
+  long lookups;     // names looked up in the scopes of a class
+  long inherits;    // conformance checks made by the checker
+  long scopes;      // scopes entered
+  long nodes;       // expressions checked
+
+  SemantCounters() : lookups(0), inherits(0), scopes(0), nodes(0) {}
+  void add(const SemantCounters &c) {
+    lookups += c.lookups;
+    inherits += c.inherits;
+    scopes += c.scopes;
+    nodes += c.nodes;
+  }
+};
+
+// Times consecutive phases: begin() ends the phase before it.
+class PhaseClock {
+private:
+  const char *phase;
+  double start;
+public:
+  PhaseClock() : phase(NULL), start(0) {}
+  ~PhaseClock() { stop(); }
+  void begin(const char *name);
+  void stop();
+};
+
+// A span in the trace for checking a class, or one of its methods,
+// from its construction to the end of its scope.
+class TraceSpan {
+private:
+  Symbol cls;
+  Symbol method;    // NULL for the whole class
+  double start;
+public:
+  TraceSpan(Symbol cls, Symbol method);
+  ~TraceSpan();
+};
+
+double stats_now_ms();
+void stats_add_class(Symbol name, double ms);
+void trace_add_class(Symbol name, double start, double end);
+void stats_add_counters(const SemantCounters &c);
+void stats_report(ostream &out);
+void trace_write();
+
+#endif
@@ -0,0 +1,43 @@
+//
+// The trace rings; see semant-trace.h.
+//
+#include <vector>
+#include <mutex>
+#include "semant-trace.h"
+
+static std::vector<TraceRing *> rings;   // one per thread that traced, never freed
+static std::mutex rings_lock;
+
+TraceRing *trace_ring_create(){
+    TraceRing *ring = new TraceRing();
+    std::lock_guard<std::mutex> guard(rings_lock);
+    ring->next = 0;
+    ring->thread = rings.size();
+    rings.push_back(ring);
+    return ring;
+}
+
+//the last entries of every thread, oldest first
+void trace_dump(ostream &out){
+    std::lock_guard<std::mutex> guard(rings_lock);
+    for(size_t r = 0; r < rings.size(); r++){
+        TraceRing *ring = rings[r];
+        unsigned long first = ring->next > TRACE_RING_SIZE ? ring->next - TRACE_RING_SIZE : 0;
+        out << "trace of thread " << ring->thread;
+        if(first > 0){
+            out << " (" << first << " earlier entries dropped)";
+        }
+        out << ":" << endl;
+        for(unsigned long i = first; i < ring->next; i++){
+            TraceEntry &e = ring->entries[i % TRACE_RING_SIZE];
+            out << "  " << e.event;
+            if(e.a != NULL){
+                out << " " << e.a;
+            }
+            if(e.b != NULL){
+                out << " " << e.b;
+            }
+            out << endl;
+        }
+    }
+}
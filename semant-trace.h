@@ -0,0 +1,70 @@
+#ifndef SEMANT_TRACE_H_
+#define SEMANT_TRACE_H_
+
+#include "cool-io.h"
+#include "stringtab.h"
+
+// Trace points for the checker.  Each one records a fixed message and
+// up to two symbols in a ring buffer of the thread that reaches it; no
+// flag is tested and nothing is formatted until the ring is dumped,
+// which -s does when the program has errors.
+//
+// Levels are chosen at compile time:
+//   1  classes and errors       TRACE_CLASS
+//   2  features, conformance    TRACE_FEATURE
+//   3  every expression         TRACE_NODE
+// Points above SEMANT_TRACE_LEVEL compile to nothing.  The Makefile sets
+// it from TRACE, 3 unless given, whether or not DEBUG is on; without it
+// debug builds trace everything and release builds nothing.
+
+#ifndef SEMANT_TRACE_LEVEL
+#ifdef DEBUG
+#define SEMANT_TRACE_LEVEL 3
+#else
+#define SEMANT_TRACE_LEVEL 0
+#endif
+#endif
+
+#define TRACE_RING_SIZE 4096
+
+struct TraceEntry {
+  const char *event;
+  Symbol a, b;
+};
+
+struct TraceRing {
+  TraceEntry entries[TRACE_RING_SIZE];
+  unsigned long next;   // entries ever recorded
+  int thread;
+};
+
+TraceRing *trace_ring_create();
+void trace_dump(ostream &out);
+
+inline void trace_record(const char *event, Symbol a = NULL, Symbol b = NULL) {
+  static thread_local TraceRing *ring = trace_ring_create();
+  TraceEntry &e = ring->entries[ring->next++ % TRACE_RING_SIZE];
+  e.event = event;
+  e.a = a;
+  e.b = b;
+}
+
+#if SEMANT_TRACE_LEVEL >= 1
+#define TRACE_CLASS(...) trace_record(__VA_ARGS__)
+#else
+#define TRACE_CLASS(...) ((void) 0)
+#endif
+
+#if SEMANT_TRACE_LEVEL >= 2
+#define TRACE_FEATURE(...) trace_record(__VA_ARGS__)
+#else
+#define TRACE_FEATURE(...) ((void) 0)
+#endif
+
+#if SEMANT_TRACE_LEVEL >= 3
+#define TRACE_NODE(...) trace_record(__VA_ARGS__)
+#else
+#define TRACE_NODE(...) ((void) 0)
+#endif
+
+#endif
@@ -5,21 +5,34 @@
 #include <stdarg.h>
 #include "semant.h"
 #include "utilities.h"
+#include "semant-alloc.h"
+#include "semant-trace.h"
+#include <vector>
+#include <set>
+#include <thread>
+#include <deque>
+#include <mutex>
+#include <algorithm>
+#include <string.h>
+#include <fstream>
 
 
 extern int semant_debug;
+extern int semant_memoize;
+extern int semant_parallel;
+extern int semant_iterative_depth;
+extern int semant_json_diagnostics;
+extern char *semant_incremental_state;
+extern int cgen_optimize;
+extern int semant_annotate;
+extern int semant_prune;
+extern int semant_stats;
+extern char *semant_trace_file;
+extern int semant_alloc_stats;
+extern int ast_parse_depth;
 extern char *curr_filename;
 
 
-//global vars used for generating error reports
-static std::ostringstream oss;
-static void wipe(){
-    oss.str("");
-    oss.clear();
-}
-ClassTable *classtable;
-Class_ semant_class;
-
 
 //////////////////////////////////////////////////////////////////////
 //
@@ -55,12 +68,15 @@ static Symbol
     Str,
     str_field,
     substr,
+    override_table,
+    tag_table,
     type_name,
     val;
 //
 // Initializing the predefined symbols.
 //
 static void initialize_constants(void){
+    AllocScope alloc(ALLOC_STRINGS);
     arg         = idtable.add_string("arg");
     arg2        = idtable.add_string("arg2");
     Bool        = idtable.add_string("Bool");
@@ -87,77 +103,112 @@ static void initialize_constants(void){
     Str         = idtable.add_string("String");
     str_field   = idtable.add_string("_str_field");
     substr      = idtable.add_string("substr");
+    //   _tag_table stands for the class numbering in incremental state,
+    //   _override_table for which dispatch slots are overridden below
+    //   each class
+    tag_table   = idtable.add_string("_tag_table");
+    override_table = idtable.add_string("_override_table");
     type_name   = idtable.add_string("type_name");
     val         = idtable.add_string("_val");
 }
 
 
 
-ClassTable::ClassTable(Classes classes) : semant_errors(0) , error_stream(cerr){
+//////////////////////////////////////////////////////////////////////
+//
+// The basic classes
+//
+// Object, IO, Int, Bool and String are the same in every program, so they
+// are built once per process (this is an abbreviated version of
+// install_base_classes from the SKEL file).  Their contents are recorded and
+// their method and attribute tables are flattened right away, after which
+// the nodes are never modified again and may be shared by every ClassTable.
+//
+//////////////////////////////////////////////////////////////////////
+BasicClasses::BasicClasses(){
+    initialize_constants();
+    Symbol basic_class_filename = stringtable.add_string("<basic class>");
+    Class_ object_class = class_(Object, No_class,
+        join3_Features(
+            method(cool_abort, nil_Formals(), Object, no_expr()),
+            method(type_name, nil_Formals(), Str, no_expr()),
+            method(copy, nil_Formals(), SELF_TYPE, no_expr())),basic_class_filename);
+    Class_ bool_class = class_(Bool, Object, single_Features(attr(val, prim_slot, no_expr())),basic_class_filename);
+    Class_ int_class = class_(Int, Object,single_Features(attr(val, prim_slot, no_expr())),basic_class_filename);
+    Class_ io_class = class_(IO, Object,
+        join4_Features(
+            method(out_string, single_Formals(formal(arg, Str)),SELF_TYPE, no_expr()),
+            method(out_int, single_Formals(formal(arg, Int)),SELF_TYPE, no_expr()),
+            method(in_string, nil_Formals(), Str, no_expr()),
+            method(in_int, nil_Formals(), Int, no_expr())),basic_class_filename);
+    Class_ str_class = class_(Str, Object,
+        join5_Features(
+            attr(val, Int, no_expr()),
+            attr(str_field, prim_slot, no_expr()),
+            method(length, nil_Formals(), Int, no_expr()),
+            method(concat,single_Formals(formal(arg, Str)),Str, no_expr()),
+            method(substr,append_Formals(single_Formals(formal(arg, Int)), single_Formals(formal(arg2, Int))),Str,no_expr())
+        ),basic_class_filename);
+
+    classes = append_Classes(
+        join3_Classes(object_class, bool_class, int_class),
+        append_Classes(single_Classes(io_class), single_Classes(str_class)));
+
+    //Object goes first, since everything else is flattened on top of it.
+    //The built-ins are known to be well formed, so there is no class
+    //table to report errors to.
+    object_class->initialize_contents(NULL);
+    object_class->flatten(NULL);
+    object_class->layout_dispatch(NULL);
+    for(int i = classes->next(classes->first()); classes->more(i); i = classes->next(i)) {
+        classes->nth(i)->initialize_contents(NULL);
+        classes->nth(i)->flatten(object_class);
+        classes->nth(i)->layout_dispatch(object_class);
+    }
+}
+
+BasicClasses *BasicClasses::get(){
+    static BasicClasses *basic = new BasicClasses();
+    return basic;
+}
 
-    //first install the built-ins (this is an abbreviated version 
-    //of install_base_classes from the SKEL file)
+ClassTable::ClassTable(Classes classes) : semant_errors(0){
     class_table = new std::map<Symbol, Class_>;
-    Symbol basic_class_filename = stringtable.add_string("<basic class>");
-    install_class(
-        Object, 
-        class_(Object, No_class,
-            join3_Features(
-                method(cool_abort, nil_Formals(), Object, no_expr()),
-                method(type_name, nil_Formals(), Str, no_expr()),
-                method(copy, nil_Formals(), SELF_TYPE, no_expr())),basic_class_filename)
-	);
-	install_class(
-        Bool, 
-        class_(Bool, Object, single_Features(attr(val, prim_slot, no_expr())),basic_class_filename)
-    );
-    install_class(
-        Int, 
-        class_(Int, Object,single_Features(attr(val, prim_slot, no_expr())),basic_class_filename)
-    );
-    install_class(
-        IO, 
-        class_(IO, Object,
-            join4_Features(
-                method(out_string, single_Formals(formal(arg, Str)),SELF_TYPE, no_expr()),
-                method(out_int, single_Formals(formal(arg, Int)),SELF_TYPE, no_expr()),
-                method(in_string, nil_Formals(), Str, no_expr()),
-                method(in_int, nil_Formals(), Int, no_expr())),basic_class_filename)
-    );
-    install_class(
-        Str, 
-        class_(Str, Object,
-            join5_Features(
-                attr(val, Int, no_expr()),
-                attr(str_field, prim_slot, no_expr()),
-                method(length, nil_Formals(), Int, no_expr()),
-                method(concat,single_Formals(formal(arg, Str)),Str, no_expr()),
-                method(substr,append_Formals(single_Formals(formal(arg, Int)), single_Formals(formal(arg2, Int))),Str,no_expr())
-            ),basic_class_filename)
-    );
-    
+    child_table = new std::map<Symbol, std::list<Class_> >;
+    rooted_classes = new std::set<Symbol>;
+    overridden_below = new std::map<Symbol, std::vector<bool> >;
+    tags = new std::vector<ClassTag>;
+    tag_index = new std::map<Symbol, int>;
+
+    //first install the shared built-ins
+    std::vector<Class_> all;
+    BasicClasses::get()->get_classes()->elements(all);
+
     //now install all the classes given as arguments
-    for(int i = classes->first(); classes->more(i); i = classes->next(i)) {
-        install_class(classes->nth(i)->get_name(), classes->nth(i));
+    classes->elements(all);
+    for(size_t i = 0; i < all.size(); i++) {
+        install_class(all[i]->get_name(), all[i]);
     }
 }
 
+//a class that cannot be installed is reported and left out; the first
+//definition of a duplicated name is the one that gets checked
 void ClassTable::install_class(Symbol id, Class_ cls){
     if (class_table->find(id) != class_table->end()) {
-        semant_error(cls);
-        wipe(); oss << "Class " << id << " is duplicated" << endl;
-        throw oss.str();
+        semant_error(cls, "duplicate-class") << "Class " << id << " is duplicated" << endl;
     }else if (id == SELF_TYPE) {
-        semant_error(cls);
-        wipe(); oss << "Class cannot have name SELF_TYPE" << endl;
-        throw oss.str();
+        semant_error(cls, "self-type-class") << "Class cannot have name SELF_TYPE" << endl;
+    }else{
+        class_table->insert(std::pair<Symbol, Class_>(id, cls));
     }
-    class_table->insert(std::pair<Symbol, Class_>(id, cls));
 }
 
 void ClassTable::initialize_class_contents(){
     for (std::map<Symbol, Class_>::iterator it = class_table->begin(); it != class_table->end(); it++) {
-        it->second->initialize_contents();
+        //the basic classes were filled in when they were built
+        if(!it->second->isFrozen()){
+            it->second->initialize_contents(this);
+        }
     }
 }
 
@@ -167,10 +218,9 @@ void ClassTable::initialize_inheritance_tree(){
             std::map<Symbol, Class_>::iterator it2;
             Symbol parent = it->second->get_parent();
             if((it2 = class_table->find(parent)) == class_table->end()){
-                wipe(); oss << "The class " << it->second->get_name() << " has parent: "<< parent << " which was not found."<< endl;
-                throw oss.str();
+                semant_error(it->second, "undefined-parent") << "The class " << it->second->get_name() << " has parent: "<< parent << " which was not found."<< endl;
             }else{
-                it2->second->add_child(it->second);
+                (*child_table)[parent].push_front(it->second);
             }
         }
     }
@@ -180,21 +230,66 @@ void ClassTable::validate_classes(){
 
     // require the presence of of Main and Object
     if(class_table->find(Main) == class_table->end()){
-        wipe(); oss << "Main class missing from class table"<<endl;
-        throw oss.str();
-    }else if(class_table->find(Object) == class_table->end()){
-        wipe(); oss << "Object class missing from class table"<<endl;
-        throw oss.str();
+        semant_error("missing-main") << "Main class missing from class table"<<endl;
+    }
+    if(class_table->find(Object) == class_table->end()){
+        semant_error("missing-object") << "Object class missing from class table"<<endl;
     }else{
 
-        // require that all classes descending from object are visited only once.
-        class_table->find(Object)->second->validate_inheritanceR();
-        
+        // visit every class that descends from Object.  The tree is walked with
+        // an explicit stack so that very deep hierarchies cannot overflow the
+        // call stack.  Only the classes reached here are checked any further.
+        std::set<Symbol> &visited = *rooted_classes;
+        std::vector<Symbol> stack;
+        stack.push_back(Object);
+        while(!stack.empty()){
+            Symbol c = stack.back();
+            stack.pop_back();
+            visited.insert(c);
+            std::list<Class_> *children = getChildren(c);
+            for(std::list<Class_>::iterator it = children->begin(); it != children->end(); it++){
+                stack.push_back((*it)->get_name());
+            }
+        }
+
+        // every class that was not visited either sits on an inheritance cycle,
+        // hangs below one or hangs below an undefined parent.  Each class has
+        // exactly one parent, so following parent edges from an unvisited class
+        // ends on a cycle, on an undefined class or on a class that an earlier
+        // walk already settled.  Walks are numbered, and meeting a class marked
+        // by the current walk means a new cycle was found.  Cycle members are
+        // marked -1 and classes below an undefined parent -2, since that parent
+        // was reported when the tree was built.
+        std::map<Symbol, int> walk_of;
+        int walk = 0;
+        for(std::map<Symbol, Class_>::iterator it = class_table->begin(); it != class_table->end(); it++){
+            if(visited.count(it->first) || walk_of.find(it->first) != walk_of.end()){
+                continue;
+            }
+            walk++;
+            Symbol s = it->first;
+            while(classExists(s) && !visited.count(s) && walk_of.find(s) == walk_of.end()){
+                walk_of[s] = walk;
+                s = getClass(s)->get_parent();
+            }
+            if(walk_of.find(s) != walk_of.end() && walk_of[s] == walk){
+                Symbol c = s;
+                do{
+                    semant_error(getClass(c), "inheritance-cycle") << "Class " << c << ", or an ancestor of " << c << ", is involved in an inheritance cycle." << endl;
+                    walk_of[c] = -1;
+                    c = getClass(c)->get_parent();
+                }while(c != s);
+            }else if(!classExists(s) || (walk_of.find(s) != walk_of.end() && walk_of[s] == -2)){
+                for(Symbol c = it->first; classExists(c) && walk_of[c] == walk; c = getClass(c)->get_parent()){
+                    walk_of[c] = -2;
+                }
+            }
+        }
+
         //require that every class descends from Object
         for(std::map<Symbol, Class_>::iterator it = class_table->begin(); it != class_table->end(); it++){
-            if(!(it->second->isVisited())){
-                wipe(); oss << "Class " << it->second->get_name() << " was never visited, and is therefore detached from Object"<<endl;
-                throw oss.str();
+            if(!visited.count(it->first) && walk_of[it->first] > 0){
+                semant_error(it->second, "detached-class") << "Class " << it->second->get_name() << " was never visited, and is therefore detached from Object" << endl;
             }
         }
     }
@@ -203,11 +298,11 @@ void ClassTable::validate_classes(){
 void ClassTable::validate_features(){
     for(std::map<Symbol, Class_>::iterator cit = class_table->begin(); cit != class_table->end(); cit++){
     
-        //for each non-root class...
+        //for each non-root class whose parent exists...
         Class_ child = cit->second;
         Symbol parent_sym = child->get_parent();
-        Class_ parent = class_table->find(parent_sym)->second;
-        if(!(parent_sym == No_class)){
+        if(!(parent_sym == No_class) && classExists(parent_sym)){
+            Class_ parent = getClass(parent_sym);
         
             //check for mismatched override methods...
             std::map<Symbol, Feature> *cmtable = child->mtable(); 
@@ -217,8 +312,7 @@ void ClassTable::validate_features(){
                 if(pmtable->find(cmethod->get_name()) != pmtable->end()){
                     Feature pmethod = pmtable->find(cmethod->get_name())->second;
                     if(isMismatchedOverride(cmethod,pmethod)){
-                        wipe(); oss << "method with name "<< cmethod->get_name() << " in class " << child << " is mismatched with a method with the same name from parent class: " << parent<<endl;
-                        throw oss.str();
+                        semant_error(child, cmethod, "bad-override") << "method with name "<< cmethod->get_name() << " in class " << child->get_name() << " is mismatched with a method with the same name from parent class: " << parent_sym<<endl;
                     }
                 }
             }
@@ -229,8 +323,7 @@ void ClassTable::validate_features(){
             for (int i = cfeatures->first(); cfeatures->more(i); i = cfeatures->next(i)) {
                 Feature f = cfeatures->nth(i);
                 if(!f->isMethod() && potable->probe(f->get_name()) != NULL){
-                    wipe(); oss << "attribute with name "<< f->get_name() << " in class " << child << " is also defined in parent class: " << parent<<endl;
-                    throw oss.str();
+                    semant_error(child, f, "redefined-attribute") << "attribute with name "<< f->get_name() << " in class " << child->get_name() << " is also defined in parent class: " << parent_sym<<endl;
                 }
             }
         }
@@ -265,567 +358,2312 @@ bool ClassTable::identicalFormals(Formals f1, Formals f2){
     return true;
 }
 
-//true if s1 <= s2
-bool ClassTable::inherits(Symbol s1, Symbol s2){
-    
-
-
+//true if s1 <= s2, where SELF_TYPE stands for the class `current'.
+//No_type and classes with a broken ancestry were already reported, so
+//they conform to anything rather than cause more errors.
+bool ClassTable::inherits(Symbol s1, Symbol s2, Class_ current, ConformCache *cache){
     if(s1 == No_type || s2 == No_type || (s1==SELF_TYPE && s2==SELF_TYPE)
-    || s1 == s2 || (s1==SELF_TYPE && semant_class->get_name() == s2)){
+    || s1 == s2 || (s1==SELF_TYPE && current->get_name() == s2)){
         return true;
     }else if (s2 == SELF_TYPE){
-        if(semant_debug){cerr<<s1<<" does not inherit "<<s2<<" because s2 is SELF_TYPE"<<endl;}
+        TRACE_FEATURE("does not inherit, the second is SELF_TYPE:", s1, s2);
         return false;
     }else{
         if(s1==SELF_TYPE){
-            s1 = semant_class->get_name();
+            s1 = current->get_name();
         }
         if(!classExists(s1)){
-            if(semant_debug){cerr<<s1<<" does not inherit "<<s2<<" because s1 does not exist"<<endl;}
+            TRACE_FEATURE("does not inherit, the first does not exist:", s1, s2);
             //TODO -error
             return false;
         }else if(!classExists(s2)){
-            if(semant_debug){cerr<<s1<<" does not inherit "<<s2<<" because s2 does not exist"<<endl;}
+            TRACE_FEATURE("does not inherit, the second does not exist:", s1, s2);
             //TODO -error
             return false;
+        }else if(!isRooted(s1) || !isRooted(s2)){
+            return true;
         }else{
-            Symbol p1 = getClass(s1)->get_parent();
-            if(p1==No_class){
-                if(semant_debug){cerr<<s1<<" does not inherit "<<s2<<" because s1's parent is No_class"<<endl;}
-                return false;
-            }else{
-                return inherits(p1,s2);
-            }
+            return conforms(s1, s2, cache);
+        }
+    }
+}
+
+//true if s2 is an ancestor of s1, where both are existing class names.
+//Given a cache, the answer for each pair is remembered, since the same
+//pairs (arguments against String, returns against their declared type,
+//...) come up over and over.
+bool ClassTable::conforms(Symbol s1, Symbol s2, ConformCache *cache){
+    std::pair<Symbol, Symbol> key(s1, s2);
+    if(cache != NULL){
+        std::map<std::pair<Symbol, Symbol>, bool>::iterator it = cache->results.find(key);
+        if(it != cache->results.end()){
+            cache->hits++;
+            return it->second;
+        }
+        cache->misses++;
+    }
+
+    // walk up the parent chain; deep hierarchies would otherwise
+    // recurse once per level
+    bool result = false;
+    for(Symbol p = s1; p != No_class; p = getClass(p)->get_parent()){
+        if(p == s2){
+            result = true;
+            break;
         }
     }
+    if(!result){TRACE_FEATURE("does not inherit, not an ancestor:", s1, s2);}
+
+    if(cache != NULL){
+        cache->results.insert(std::make_pair(key, result));
+    }
+    return result;
 }
 
 bool ClassTable::classExists(Symbol s1){
     return class_table->find(s1) != class_table->end();
 }
 
-//assumes that s1 exists
+//true if s1 is a class that descends from Object, once validate_classes
+//has run.  Only these classes are safe to walk up from.
+bool ClassTable::isRooted(Symbol s1){
+    return rooted_classes->find(s1) != rooted_classes->end();
+}
+
+//the classes that name s1 as their parent
+std::list<Class_> *ClassTable::getChildren(Symbol s1){
+    return &(*child_table)[s1];
+}
+
+//assumes that s1 exists and is not SELF_TYPE
 Class_ ClassTable::getClass(Symbol s1){
-    if(s1==SELF_TYPE){
-        s1 = semant_class->get_name();
-    }
     return class_table->find(s1)->second;
 }
 
-void ClassTable::addToCurrentScope(Symbol name, Symbol type){
-    SymbolTable<Symbol, Symbol> *otable = semant_class->otable();
-    if(name==self){
-        classtable->semant_error(semant_class);
-        //TODO - error
-    }else if(otable->probe(name)){
-        classtable->semant_error(semant_class);
-        //TODO - error
-    }else{
-        otable->addid(name, new Symbol(type));
+//a flattened class answers for its whole ancestry, so the walk stops there
+Symbol ClassTable::get_attr(Class_ cls, Symbol s1){
+    for(Class_ c = cls; ; c = getClass(c->get_parent())){
+        if(c->isFrozen()){
+            std::map<Symbol, Symbol>::iterator it = c->flat_otable()->find(s1);
+            return it != c->flat_otable()->end() ? it->second : NULL;
+        }
+        Symbol *stype = c->otable()->lookup(s1);
+        if(stype != NULL){
+            return *stype;
+        }else if(c->get_parent() == No_class){
+            return NULL;
+        }
+    }
+}
+
+Feature ClassTable::get_method(Class_ cls, Symbol method){
+    for(Class_ c = cls; ; c = getClass(c->get_parent())){
+        std::map<Symbol, Feature> *table = c->isFrozen() ? c->flat_mtable() : c->mtable();
+        std::map<Symbol, Feature>::iterator it = table->find(method);
+        if(it != table->end()){
+            return it->second;
+        }else if(c->isFrozen() || c->get_parent() == No_class){
+            return NULL;
+        }
     }
 }
 
 ////////////////////////////////////////////////////////////////////
 //
 // semant_error is an overloaded function for reporting errors
-// during semantic analysis.  There are three versions:
+// during semantic analysis.  Each opens a record in a diagnostic sink
+// and returns the stream its message is written to.  There are four
+// versions:
+//
+//    ostream& ClassTable::semant_error(code)
+//       an error that belongs to no class
 //
-//    ostream& ClassTable::semant_error()                
+//    ostream& ClassTable::semant_error(Class_ c, code)
+//       an error at the definition of `c'
 //
-//    ostream& ClassTable::semant_error(Class_ c)
-//       print line number and filename for `c'
+//    ostream& ClassTable::semant_error(Class_ c, tree_node *t, code)
+//       an error at `t', somewhere inside `c'
 //
-//    ostream& ClassTable::semant_error(Symbol filename, tree_node *t)  
-//       print a line number and filename
+//    ostream& ClassTable::semant_error(sink, Class_ c, tree_node *t, code)
+//       as above, but recorded in `sink' instead of the class table's
 //
 ///////////////////////////////////////////////////////////////////
 
-ostream& ClassTable::semant_error(Class_ c){      
-    if(semant_debug){cout<<"semant_error called with class: "<<c->get_name()<<endl;}                                                       
-    return semant_error(c->get_filename(),c);
-}    
+ostream& ClassTable::semant_error(const char *code){
+    semant_errors++;
+    return diagnostics.report(NULL, 0, NULL, code, true);
+}
 
-ostream& ClassTable::semant_error(Symbol filename, tree_node *t){
-    error_stream << filename << ":" << t->get_line_number() << ": ";
-    return semant_error();
+ostream& ClassTable::semant_error(Class_ c, const char *code){
+    TRACE_CLASS("semant_error called with class:", c->get_name());
+    return semant_error(c, c, code);
 }
 
-ostream& ClassTable::semant_error(){                                                 
-    semant_errors++;                            
-    return error_stream;
-} 
+ostream& ClassTable::semant_error(Class_ c, tree_node *t, const char *code){
+    return semant_error(diagnostics, c, t, code);
+}
 
-//////////////////////////////////////initializers////////////////////////////////////
-void class__class::initialize_contents(){
-    if(semant_debug){cout<<"initializing class contents" << endl;}
-    for(int i = features->first(); features->more(i); i = features->next(i)) {
-        features->nth(i)->initialize(this);
-    }
+ostream& ClassTable::semant_error(DiagnosticSink& sink, Class_ c, tree_node *t, const char *code){
+    semant_errors++;
+    return sink.report(c->get_filename(), t->get_line_number(), c->get_name(), code, true);
 }
 
-void method_class::initialize(Class_ c){
-    if(c->mtable()->find(name) != c->mtable()->end()){
-        wipe(); oss << name << " is not a unique method name within " << c->get_name();
-        throw oss.str();     
-    }else if(name == self){
-        wipe(); oss << "illegal method name: " << name << " within: " << c->get_name();
-        throw oss.str();
+//records a diagnostic kept from an earlier run, counting it if it is an error
+void ClassTable::replay(const Diagnostic &d){
+    if(d.error){
+        semant_errors++;
     }
-    if(semant_debug){cout<<"initializing method: " << name << endl;}
-    c->mtable()->insert(std::pair<Symbol, Feature>(name, this));    
+    diagnostics.add(d);
 }
 
-void attr_class::initialize(Class_ c){
-    if(c->otable()->probe(name)){
-        wipe(); oss << name << " is not a unique attribute name within " << c->get_name();
-        throw oss.str();
-    } else if (name == self){
-        wipe(); oss << "illegal attribute name: " << name << " within: " << c->get_name();
-        throw oss.str();
-    }
-    if(semant_debug){cout<<"initializing attr contents for: " << name << " with type: "<< type_decl << endl;}
-    c->otable()->addid(name, new Symbol(type_decl));
+//opens a new record; whatever was written to the stream since the last
+//one becomes that record's message
+ostream& DiagnosticSink::report(Symbol filename, int line, Symbol class_name, const char *code, bool error){
+    AllocScope alloc(ALLOC_DIAGNOSTICS);
+    commit();
+    Diagnostic d;
+    d.filename = filename;
+    d.line = line;
+    d.class_name = class_name;
+    d.code = code;
+    d.error = error;
+    records.push_back(d);
+    pending.str("");
+    has_pending = true;
+    return pending;
 }
 
-void class__class::validate_inheritanceR(){
-    if(isVisited()){
-        wipe(); oss << "Class " << name << " has been visited more than once in a tree traversal, which indicates a cycle is present";
-        throw oss.str();
-    }else{
-        visit();
-        for(std::list<Class_>::iterator it = child_list->begin(); it != child_list->end(); it++){
-            (*it)-> validate_inheritanceR();
+void DiagnosticSink::commit(){
+    AllocScope alloc(ALLOC_DIAGNOSTICS);
+    if(has_pending){
+        std::string message = pending.str();
+        while(!message.empty() && message[message.size() - 1] == '\n'){
+            message.erase(message.size() - 1);
         }
+        records.back().message = message;
+        has_pending = false;
     }
 }
 
-Symbol class__class::get_attr(Symbol s1){
-    Symbol *stype = object_table->lookup(s1);
-    if(stype != NULL){
-        return *stype;
-    }else if(get_parent() == No_class){
-        return NULL;
-    }else{
-        return classtable->getClass(get_parent())->get_attr(s1);
-    }
+//moves the records of `other' to the end of this sink
+void DiagnosticSink::append(DiagnosticSink &other){
+    AllocScope alloc(ALLOC_DIAGNOSTICS);
+    commit();
+    other.commit();
+    records.insert(records.end(), other.records.begin(), other.records.end());
+    other.records.clear();
 }
 
-Feature class__class::get_method(Symbol method){
-    std::map<Symbol, Feature>::iterator it = method_table->find(method);
-    if(it!=method_table->end()){
-         return it->second;
-    }else if(get_parent() != No_class){
-        return classtable->getClass(get_parent())->get_method(method);
-    }else{
-        return NULL;
+static bool diagnostic_before(const Diagnostic &a, const Diagnostic &b){
+    if(a.filename != b.filename){
+        if(a.filename == NULL || b.filename == NULL){
+            return a.filename == NULL;
+        }
+        int cmp = strcmp(a.filename->get_string(), b.filename->get_string());
+        if(cmp != 0){
+            return cmp < 0;
+        }
     }
+    return a.line < b.line;
 }
 
-
-///////////////////////////////////////semants////////////////////////////////////////
-void isvoid_class::semant(){e1->semant();type=Bool;}
-void no_expr_class::semant(){type=No_type;}
-void bool_const_class::semant(){type = Bool;}
-void string_const_class::semant(){type = Str;}
-void int_const_class::semant(){type = Int;}
-void object_class::semant(){
-    if(name==self){type=SELF_TYPE;}
-    else{
-        Symbol t = semant_class->get_attr(name);
-        if(t==NULL){
-            classtable->semant_error(semant_class);
-            cerr << "object cannot be found in scope: "<<name<<endl;
-        }else{
-            type = t;
+//orders records by everything that is shown, so that a repeat compares
+//equal to the record it repeats wherever the two ended up
+struct DiagnosticKeyBefore {
+    bool operator()(const Diagnostic *a, const Diagnostic *b) const {
+        if(a->filename != b->filename){
+            return a->filename < b->filename;
+        }
+        if(a->line != b->line){
+            return a->line < b->line;
         }
+        if(a->class_name != b->class_name){
+            return a->class_name < b->class_name;
+        }
+        int cmp = a->code.compare(b->code);
+        if(cmp != 0){
+            return cmp < 0;
+        }
+        return a->message < b->message;
     }
-}
-void new__class::semant(){
-    if(semant_debug){cerr<<"begin semant in new__class"<<endl;}
-    if(!classtable->classExists(type_name)){
-        classtable->semant_error(semant_class);
-        cerr << "class: "<<type_name<<" cannot be found"<<endl;
-        type=No_type;
-    }else{
-        type=type_name;
+};
+
+static void json_string(std::string &out, const char *s){
+    out += '"';
+    for(; *s; s++){
+        switch(*s){
+        case '"':  out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if((unsigned char) *s < 0x20){
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", *s);
+                out += buf;
+            }else{
+                out += *s;
+            }
+        }
     }
+    out += '"';
 }
 
-void dispatch_class::semant(){
-    if(semant_debug){cerr<<"begin semant in dispatch_class"<<endl;}
-    expr->semant();
-    Class_ caller = classtable->getClass(expr->get_type());
-    Feature method = caller->get_method(name);
-    if(method==NULL){
-        classtable->semant_error(semant_class);
-        cerr << "method: "<<name<<" cannot be found in class: "<<caller<<endl;
-    }else if(method->get_formals()->len() != actual->len()){
-        classtable->semant_error(semant_class);
-        cerr << "method: "<<name<<" has "<<method->get_formals()->len()<<" arguments, but is called with "<<actual->len()<<endl;
-    }else{
-        for(int i= actual->first(); actual->more(i); i=actual->next(i)){
-            actual->nth(i)->semant();
-            Symbol ftype = method->get_formals()->nth(i)->get_type();
-            if(!classtable->inherits(actual->nth(i)->get_type(), ftype)){
-                classtable->semant_error(semant_class);
-                cerr << "method arg "<<i+1<<" should be of type: "<<ftype<<" but is of type: "<<actual->nth(i)->get_type()<<endl;
-            }       
-        }
-        Symbol t = method->get_type();
-        if(t==SELF_TYPE){
-            type=expr->get_type();
-        }else{
-            type=t;
+//Sorting is stable, so records on the same line keep the order in which
+//they were found.  Only the first of identical records is written, even
+//when other records on the same line were found between them.
+void DiagnosticSink::flush(ostream& out, bool json){
+    AllocScope alloc(ALLOC_DIAGNOSTICS);
+    commit();
+    std::stable_sort(records.begin(), records.end(), diagnostic_before);
+    std::set<const Diagnostic*, DiagnosticKeyBefore> seen;
+    std::string text;
+    for(size_t i = 0; i < records.size(); i++){
+        Diagnostic &d = records[i];
+        if(!seen.insert(&d).second){
+            continue;
         }
-    }
-    if(semant_debug){cerr<<"finish semant in dispatch_class"<<endl;}
-}
-void static_dispatch_class::semant(){
-    if(semant_debug){cerr<<"begin semant in static_dispatch_class"<<endl;}
-    expr->semant();
-    if(!classtable->inherits(expr->get_type(), type_name)){
-        classtable->semant_error(semant_class);
-        cerr << "type mismatch in static dispatch: "<<endl;
-    }else{
-        Class_ caller = classtable->getClass(expr->get_type());
-        Feature method = caller->get_method(name);
-        if(method==NULL){
-            classtable->semant_error(semant_class);
-            cerr << "method: "<<name<<" cannot be found in class: "<<caller<<endl;
-        }else if(method->get_formals()->len() != actual->len()){
-            classtable->semant_error(semant_class);
-            cerr << "method: "<<name<<" has "<<method->get_formals()->len()<<" arguments, but is called with "<<actual->len()<<endl;
+        if(json){
+            text += "{\"file\":";
+            if(d.filename != NULL){ json_string(text, d.filename->get_string()); }else{ text += "null"; }
+            text += ",\"line\":" + std::to_string(d.line);
+            text += ",\"class\":";
+            if(d.class_name != NULL){ json_string(text, d.class_name->get_string()); }else{ text += "null"; }
+            text += ",\"code\":";
+            json_string(text, d.code.c_str());
+            text += d.error ? ",\"severity\":\"error\"" : ",\"severity\":\"warning\"";
+            text += ",\"message\":";
+            json_string(text, d.message.c_str());
+            text += "}\n";
         }else{
-            for(int i= actual->first(); actual->more(i); i=actual->next(i)){
-                actual->nth(i)->semant();
-                Symbol ftype = method->get_formals()->nth(i)->get_type();
-                if(!classtable->inherits(actual->nth(i)->get_type(), ftype)){
-                    classtable->semant_error(semant_class);
-                    cerr << "method arg "<<i+1<<" should be of type: "<<ftype<<" but is of type: "<<actual->nth(i)->get_type()<<endl;
-                }       
-            }
-            Symbol t = method->get_type();
-            if(t==SELF_TYPE){
-                type=expr->get_type();
-            }else{
-                type=t;
+            if(d.filename != NULL){
+                text += std::string(d.filename->get_string()) + ":" + std::to_string(d.line) + ": ";
             }
+            if(!d.error){
+                text += "warning: ";
+            }
+            text += d.message + "\n";
         }
     }
-    if(semant_debug){cerr<<"finish semant in static_dispatch_class"<<endl;}
+    records.clear();
+    out.write(text.data(), text.size());
+    out.flush();
 }
 
-void typcase_class::semant(){
-    if(semant_debug){cerr<<"begin semant in typcase_class"<<endl;}
-    type=Object;
-    //TODO
+//////////////////////////////////////////////////////////////////////
+//
+// SemantContext
+//
+// Everything that changes while a class is being checked: the class
+// itself, the scopes opened by formals, lets and case branches, the
+// remembered conformance answers and the sink that diagnostics go to.
+// The class table is only read once the classes have been validated, so
+// any number of contexts may check side by side.
+//
+//////////////////////////////////////////////////////////////////////
+SemantContext::SemantContext(ClassTable *ct, DiagnosticSink& sink) : classtable(ct), cls(NULL), scope(NULL), diagnostics(&sink), iterative(false), depends(NULL),
+    monomorphic_sites(0), polymorphic_sites(0){}
+
+//start checking (part of) class c with fresh scopes
+void SemantContext::enter_class(Class_ c){
+    AllocScope alloc(ALLOC_SYMBOLS);
+    cls = c;
+    scope = new SymbolTable<Symbol, Symbol>();
 }
 
-void let_class::semant(){
-    if(semant_debug){cerr<<"begin semant in let_class"<<endl;}
-    SymbolTable<Symbol, Symbol> *otable = semant_class->otable();
-    init->semant();
-    otable->enterscope();
-    if(!classtable->classExists(type_decl)){
-        classtable->semant_error(semant_class);
-        cerr<<"type does not exist"<<endl;
-    }else{
-        classtable->addToCurrentScope(identifier, type_decl);
-    }
-    body->semant();
-    if(!classtable->inherits(init->get_type(), type_decl)){
-        classtable->semant_error(semant_class);
-        cerr<<"init type does not inherit declared type"<<endl;
-    }else{
-        type=body->get_type();
-    }
-    otable->exitscope();
+//opens a scope for formals, a let or a case branch
+void SemantContext::enterscope(){
+    AllocScope alloc(ALLOC_SYMBOLS);
+    counters.scopes++;
+    scope->enterscope();
 }
 
-void plus_class::semant(){
-    if(semant_debug){cerr<<"begin semant in plus_class"<<endl;}
-    e1->semant();
-    e2->semant();
-    if(e1->get_type() != Int || e2->get_type() != Int){
-        classtable->semant_error(semant_class);
-        cerr << "both arguments for plus must be Ints"<<endl;
-    }else{
-        type=Int;
-    }
+ostream& SemantContext::semant_error(tree_node *t, const char *code){
+    return classtable->semant_error(*diagnostics, cls, t, code);
 }
 
-void eq_class::semant(){
-    if(semant_debug){cerr<<"begin semant in eq_class"<<endl;}
-    e1->semant();
-    e2->semant();
-    Symbol e1_type = e1->get_type();
-    Symbol e2_type = e2->get_type();
-    if((e1_type==Int||e1_type== Bool||e1_type==Str||e2_type==Int||e2_type==Bool||e2_type==Str)
- 	    &&e1_type!=e2_type){
-        classtable->semant_error(semant_class);
-        cerr << "cannot compare with equals the types: "<<e1->get_type()<<" and "<<e2->get_type()<<endl;	
- 	}else{
- 	    type=Bool;
- 	}
+//for messages that are not counted as errors
+ostream& SemantContext::warning(tree_node *t, const char *code){
+    return diagnostics->report(cls->get_filename(), t->get_line_number(), cls->get_name(), code, false);
 }
 
-void mul_class::semant(){
-    if(semant_debug){cerr<<"begin semant in  mul_class"<<endl;}
-    e1->semant();
-    e2->semant();
-    if(e1->get_type() != Int || e2->get_type() != Int){
-        classtable->semant_error(semant_class);
-        cerr << "both arguments for multiply must be Ints"<<endl;
-    }else{
-        type=Int;
+//remembers that the outcome of the checks depends on class s1
+void SemantContext::depends_on(Symbol s1){
+    if(depends != NULL && s1 != SELF_TYPE && s1 != No_type){
+        depends->insert(s1);
     }
 }
 
-void divide_class::semant(){
-    if(semant_debug){cerr<<"begin semant in div_class"<<endl;}
-    e1->semant();
-    e2->semant();
-    if(e1->get_type() != Int || e2->get_type() != Int){
-        classtable->semant_error(semant_class);
-        cerr << "both arguments for divide must be Ints"<<endl;
+bool SemantContext::inherits(Symbol s1, Symbol s2){
+    counters.inherits++;
+    depends_on(s1);
+    depends_on(s2);
+    return classtable->inherits(s1, s2, cls, semant_memoize ? &conform_cache : NULL);
+}
+
+Symbol SemantContext::lub(Symbol s1, Symbol s2){
+    depends_on(s1);
+    depends_on(s2);
+    return classtable->lub(s1, s2, cls);
+}
+
+bool SemantContext::classExists(Symbol s1){
+    depends_on(s1);
+    return classtable->classExists(s1);
+}
+
+Class_ SemantContext::getClass(Symbol s1){
+    depends_on(s1);
+    return classtable->getClass(s1 == SELF_TYPE ? cls->get_name() : s1);
+}
+
+//locals first, then the attributes of the current class and its ancestors
+Symbol SemantContext::lookup_object(Symbol name){
+    counters.lookups++;
+    Symbol *local = scope->lookup(name);
+    return local != NULL ? *local : classtable->get_attr(cls, name);
+}
+
+void SemantContext::addToCurrentScope(tree_node *t, Symbol name, Symbol type){
+    AllocScope alloc(ALLOC_SYMBOLS);
+    counters.lookups++;
+    if(name==self){
+        semant_error(t, "bound-self") << "'self' cannot be bound in a formal, let or case" << endl;
+    }else if(scope->probe(name)){
+        semant_error(t, "duplicate-binding") << name << " is multiply defined in the same scope" << endl;
     }else{
-        type=Int;
+        scope->addid(name, new Symbol(type));
     }
 }
 
-void sub_class::semant(){
-    if(semant_debug){cerr<<"begin semant in sub_class"<<endl;}
-    e1->semant();
-    e2->semant();
-    if(e1->get_type() != Int || e2->get_type() != Int){
-        classtable->semant_error(semant_class);
-        cerr << "both arguments for subtract must be Ints"<<endl;
-    }else{
-        type=Int;
+//////////////////////////////////////initializers////////////////////////////////////
+void class__class::initialize_contents(ClassTable *classtable){
+    TRACE_CLASS("initializing class contents:", name);
+    for(int i = features->first(); features->more(i); i = features->next(i)) {
+        features->nth(i)->initialize(this, classtable);
     }
 }
 
-void neg_class::semant(){
-    if(semant_debug){cerr<<"begin semant in neg_class"<<endl;}
-    e1->semant();
-    if(e1->get_type() != Int){
-        classtable->semant_error(semant_class);
-        cerr << "the argument for negation must be an Int"<<endl;
-    }else{
-        type=Int;
+//a feature that cannot be recorded is reported and left out of the
+//tables; the first definition of a name is the one that counts
+void method_class::initialize(Class_ c, ClassTable *classtable){
+    if(c->mtable()->find(name) != c->mtable()->end()){
+        classtable->semant_error(c, this, "duplicate-method") << name << " is not a unique method name within " << c->get_name() << endl;
+        return;
+    }else if(name == self){
+        classtable->semant_error(c, this, "self-method") << "illegal method name: " << name << " within: " << c->get_name() << endl;
+        return;
     }
+    TRACE_FEATURE("initializing method:", name);
+    c->mtable()->insert(std::pair<Symbol, Feature>(name, this));    
 }
-void comp_class::semant(){
-    if(semant_debug){cerr<<"begin semant in comp_class"<<endl;}
-    e1->semant();
-    if(e1->get_type() != Bool){
-        classtable->semant_error(semant_class);
-        cerr << "the argument for complementation must be a Bool"<<endl;
-    }else{
-        type=Bool;
+
+void attr_class::initialize(Class_ c, ClassTable *classtable){
+    if(c->otable()->probe(name)){
+        classtable->semant_error(c, this, "duplicate-attribute") << name << " is not a unique attribute name within " << c->get_name() << endl;
+        return;
+    } else if (name == self){
+        classtable->semant_error(c, this, "self-attribute") << "illegal attribute name: " << name << " within: " << c->get_name() << endl;
+        return;
     }
+    TRACE_FEATURE("initializing attr:", name, type_decl);
+    c->otable()->addid(name, new Symbol(type_decl));
 }
 
-void lt_class::semant(){
-    if(semant_debug){cerr<<"begin semant in lt_class"<<endl;}
-    e1->semant();
-    e2->semant();
-    if(e1->get_type() != Int || e2->get_type() != Int){
-        classtable->semant_error(semant_class);
-        cerr << "both arguments for less than must be Ints"<<endl;
-    }else{
-        type=Bool;
+//builds the flattened tables from the parent's flattened tables and this
+//class's own features; once they exist the class is treated as read-only
+void class__class::flatten(Class_ parent){
+    flat_method_table = new std::map<Symbol, Feature>();
+    flat_object_table = new std::map<Symbol, Symbol>();
+    if(parent != NULL){
+        *flat_method_table = *parent->flat_mtable();
+        *flat_object_table = *parent->flat_otable();
+    }
+    for(int i = features->first(); features->more(i); i = features->next(i)) {
+        Feature f = features->nth(i);
+        if(f->isMethod()){
+            (*flat_method_table)[f->get_name()] = f;
+        }else{
+            (*flat_object_table)[f->get_name()] = f->get_type();
+        }
     }
 }
-void leq_class::semant(){
-    if(semant_debug){cerr<<"begin semant in leq_class"<<endl;}
-    e1->semant();
-    e2->semant();
-    if(e1->get_type() != Int || e2->get_type() != Int){
-        classtable->semant_error(semant_class);
-        cerr << "both arguments for less than or equals must be Ints"<<endl;
-    }else{
-        type=Bool;
+
+//Lays out the dispatch table on top of the parent's: an override keeps
+//the slot of the method it replaces and new methods are appended in the
+//order they are defined.  Each slot records the class that defines the
+//method in it and the method's name.
+void class__class::layout_dispatch(Class_ parent){
+    dispatch_layout = new std::vector<std::pair<Symbol, Symbol> >();
+    dispatch_slots = new std::map<Symbol, int>();
+    if(parent != NULL){
+        *dispatch_layout = *parent->dispatch_table();
+        for(size_t i = 0; i < dispatch_layout->size(); i++){
+            (*dispatch_slots)[(*dispatch_layout)[i].second] = i;
+        }
+    }
+    for(int i = features->first(); features->more(i); i = features->next(i)) {
+        Feature f = features->nth(i);
+        //a repeated definition was reported and left out of the method table
+        if(!f->isMethod()){
+            continue;
+        }
+        std::map<Symbol, Feature>::iterator m = method_table->find(f->get_name());
+        if(m == method_table->end() || m->second != f){
+            continue;
+        }
+        std::map<Symbol, int>::iterator it = dispatch_slots->find(f->get_name());
+        if(it != dispatch_slots->end()){
+            (*dispatch_layout)[it->second].first = name;
+        }else{
+            (*dispatch_slots)[f->get_name()] = dispatch_layout->size();
+            dispatch_layout->push_back(std::make_pair(name, f->get_name()));
+        }
     }
 }
 
+int class__class::dispatch_slot(Symbol method){
+    std::map<Symbol, int>::iterator it = dispatch_slots->find(method);
+    return it != dispatch_slots->end() ? it->second : -1;
+}
 
-void block_class::semant(){
-    if(semant_debug){cerr<<"begin semant in block_class"<<endl;}
-    for(int i=body->first();body->more(i); i=body->next(i)){
-        body->nth(i)->semant();
-        type = body->nth(i)->get_type();
+//lays out the dispatch tables of every class that descends from Object,
+//parents before children; the basic classes already have theirs.  With
+//`again', tables are laid out afresh after methods have been pruned.
+//The basic classes are shared read-only by every ClassTable and never
+//pruned, so theirs are left alone either way.
+void ClassTable::layout_dispatch_tables(bool again){
+    std::vector<Class_> stack;
+    stack.push_back(getClass(Object));
+    while(!stack.empty()){
+        Class_ c = stack.back();
+        stack.pop_back();
+        if(c->dispatch_table() == NULL || (again && !c->isFrozen())){
+            c->layout_dispatch(getClass(c->get_parent()));
+        }
+        std::list<Class_> *children = getChildren(c->get_name());
+        for(std::list<Class_>::iterator it = children->begin(); it != children->end(); it++){
+            stack.push_back(*it);
+        }
     }
 }
 
-void branch_class::semant(){
-    if(semant_debug){cerr<<"begin semant in branch_class"<<endl;}
-    SymbolTable<Symbol, Symbol> *otable = semant_class->otable();
-    otable->enterscope();
-    if(classtable->classExists(type_decl)){
-        classtable->addToCurrentScope(name,type_decl);
-    }else{
-        classtable->semant_error(semant_class);
-        cerr<<"type does not exist: "<<type_decl<<endl;
+//Class hierarchy analysis: for every class that descends from Object,
+//the dispatch table slots that some class below it overrides.  A call
+//through any other slot has the same target whatever the dynamic class
+//of the receiver.  Children are finished before their parents.
+void ClassTable::find_overrides(){
+    std::vector<Class_> order, stack;
+    stack.push_back(getClass(Object));
+    while(!stack.empty()){
+        Class_ c = stack.back();
+        stack.pop_back();
+        order.push_back(c);
+        std::list<Class_> *children = getChildren(c->get_name());
+        for(std::list<Class_>::iterator it = children->begin(); it != children->end(); it++){
+            stack.push_back(*it);
+        }
+    }
+    for(size_t i = order.size(); i-- > 0; ){
+        Class_ c = order[i];
+        std::vector<std::pair<Symbol, Symbol> > *table = c->dispatch_table();
+        std::vector<bool> &below = (*overridden_below)[c->get_name()];
+        below.assign(table->size(), false);
+        std::list<Class_> *children = getChildren(c->get_name());
+        for(std::list<Class_>::iterator it = children->begin(); it != children->end(); it++){
+            std::vector<std::pair<Symbol, Symbol> > *child_table = (*it)->dispatch_table();
+            std::vector<bool> &child_below = (*overridden_below)[(*it)->get_name()];
+            for(size_t slot = 0; slot < below.size(); slot++){
+                if((*child_table)[slot].first != (*table)[slot].first || child_below[slot]){
+                    below[slot] = true;
+                }
+            }
+        }
     }
-    expr->semant();
-    otable->exitscope();
 }
 
-void loop_class::semant(){
-    if(semant_debug){cerr<<"begin semant in loop_class"<<endl;}
-    pred->semant();
-    body->semant();
-    if (pred->get_type() != Bool) {
-        classtable->semant_error(semant_class);
-        cerr<<"pred must be Bool"<<endl; 
+//true if a call through `slot' on a receiver of static class `cls' can
+//only ever reach the method in cls's own table.  The checking threads
+//call this concurrently, so it only reads the map; a class the analysis
+//never saw is taken to be polymorphic.
+bool ClassTable::isMonomorphic(Symbol cls, int slot){
+    std::map<Symbol, std::vector<bool> >::iterator it = overridden_below->find(cls);
+    if(it == overridden_below->end() || slot < 0 || (size_t) slot >= it->second.size()){
+        return false;
     }
-    type=Object;
-    //TODO...
+    return !it->second[slot];
 }
 
-
-void cond_class::semant(){
-    if(semant_debug){cerr<<"begin semant in cond_class"<<endl;}
-    pred->semant();
-    then_exp->semant();
-    else_exp->semant();
-    if (pred->get_type() != Bool) {
-        classtable->semant_error(semant_class);
-        cerr<<"condition must have type Bool"<<endl;
-    }else{
-        type=Object;
-        //TODO...lub
-    }
+static bool later_name(Class_ a, Class_ b){
+    return strcmp(a->get_name()->get_string(), b->get_name()->get_string()) > 0;
 }
 
-void assign_class::semant(){
-    if(semant_debug){cerr<<"begin semant in assign_class"<<endl;}
-    expr->semant();
-    
-    Symbol assign_type = semant_class->get_attr(name);
-    if(assign_type==NULL){
-        classtable->semant_error(semant_class);
-        cerr<<"assign type does not exist"<<endl;
-    }else if(!classtable->inherits(expr->get_type(), assign_type)){
-        classtable->semant_error(semant_class);
-        cerr<<"assignment inheritance problem"<<endl;     
-    }else{
-        type=expr->get_type();
+//Numbers the classes that descend from Object in preorder, so that a
+//class and the classes below it have consecutive tags.  Whether an
+//object of tag t is a C is then tag(C) <= t <= last(C).  Siblings are
+//taken in order of name, so the numbering depends only on the tree.
+void ClassTable::assign_tags(){
+    tags->clear();
+    tag_index->clear();
+    std::vector<std::pair<Class_, bool> > stack;
+    stack.push_back(std::make_pair(getClass(Object), false));
+    while(!stack.empty()){
+        std::pair<Class_, bool> top = stack.back();
+        stack.pop_back();
+        Symbol name = top.first->get_name();
+        if(top.second){
+            //every class below has been numbered
+            (*tags)[(*tag_index)[name]].last = tags->size() - 1;
+            continue;
+        }
+        ClassTag t;
+        t.name = name;
+        t.tag = tags->size();
+        t.last = t.tag;
+        (*tag_index)[name] = tags->size();
+        tags->push_back(t);
+        stack.push_back(std::make_pair(top.first, true));
+        std::list<Class_> *children = getChildren(name);
+        std::vector<Class_> sorted(children->begin(), children->end());
+        std::sort(sorted.begin(), sorted.end(), later_name);
+        for(size_t i = 0; i < sorted.size(); i++){
+            stack.push_back(std::make_pair(sorted[i], false));
+        }
     }
-    if(semant_debug){cerr<<"complete semant in assign_class"<<endl;}
 }
 
+//the tag range of a class, or NULL for one that has none
+ClassTag *ClassTable::tag_of(Symbol cls){
+    std::map<Symbol, int>::iterator it = tag_index->find(cls);
+    return it != tag_index->end() ? &(*tags)[it->second] : NULL;
+}
 
+//takes a class that is no longer part of the program out of the tree, so
+//that the tables built from the tree afterwards leave it out
+void ClassTable::forget_class(Class_ c){
+    getChildren(c->get_parent())->remove(c);
+    rooted_classes->erase(c->get_name());
+}
 
-void formal_class::semant(){
-    if(semant_debug){cerr<<"begin semant in formal_class"<<endl;}
-    if(type_decl == SELF_TYPE){
-        cerr<<"formal has type==SELF_TYPE"<<endl;
+//the least class that both s1 and s2 conform to
+Symbol ClassTable::lub(Symbol s1, Symbol s2, Class_ current){
+    if(s1 == s2){
+        return s1;
     }
-    if(!classtable->classExists(type_decl)){
-        classtable->semant_error(semant_class);
-        cerr<<"class in formal does not exist"<<endl; 
-    }else{
-        classtable->addToCurrentScope(name,type_decl);
+    if(s1 == SELF_TYPE){
+        s1 = current->get_name();
     }
-}
-
-void method_class::semant(){
-    if(semant_debug){cerr<<"begin semant in method_class"<<endl;}
-    SymbolTable<Symbol, Symbol> *otable = semant_class->otable();
-    //enter the scope of the method
-    otable->enterscope();
-    
-    //call semant on child nodes
-    for(int i = formals->first(); formals->more(i); i = formals->next(i)) {
-        formals->nth(i)->semant();
+    if(s2 == SELF_TYPE){
+        s2 = current->get_name();
     }
-    expr->semant();
-    
-    //check validity of expr
-    Symbol t = expr->get_type();
-    if(semant_debug){cerr<<"checking minherits for: "<<t<<" and "<<return_type<<endl;}
-    if(!classtable->inherits(t, return_type)){
-        cerr<<"expr in method has bad type"<<endl;
+    if(!isRooted(s1) || !isRooted(s2)){
+        return Object;
     }
-    
-    otable->exitscope();
-    if(semant_debug){cerr<<"completed method semant for: "<<name<<endl;}
+    int t1 = tag_of(s1)->tag, t2 = tag_of(s2)->tag;
+    return common_ancestor(std::min(t1, t2), std::max(t1, t2));
 }
 
-void attr_class::semant(){
-    if(semant_debug){cerr<<"begin semant in attr_class"<<endl;}
-    //call semant on the expression
-    init->semant();
-    
-    //verify that the expression type inherits the declared type
-    Symbol t = init->get_type();
-    if(semant_debug){cerr<<"checking ainherits for: "<<t<<" and "<<type_decl<<endl;}
-    if(!classtable->inherits(t, type_decl)){
-        cerr<<"attribute type mismatch"<<endl;
+//the closest class whose tag range holds both lo and hi, with lo <= hi.
+//Only the ancestors of the class tagged lo have ranges that start at or
+//before lo, so it is the first of them whose range reaches hi.
+Symbol ClassTable::common_ancestor(int lo, int hi){
+    Symbol c = (*tags)[lo].name;
+    while(tag_of(c)->last < hi){
+        c = getClass(c)->get_parent();
     }
-    if(semant_debug){cerr<<"completed attr semant for: "<<name<<endl;}
+    return c;
 }
 
-void class__class::semant(){
-    if(semant_debug){cerr<<"begin semant in class__class"<<endl;}
-    for(int i = features->first(); features->more(i); i = features->next(i)) {
-        features->nth(i)->semant();
+
+///////////////////////////////////////semants////////////////////////////////////////
+//
+// Expressions are checked in two parts.  semant_next(ctx, step) is called
+// with step = 0, 1, 2, ... and returns the next child to check, doing any
+// work that has to happen between children (opening a let scope, checking
+// the argument just finished, ...), or NULL once the children are done.
+// semant_finish then assigns the type of the node.  The recursive checker
+// and the iterative one below drive the same two functions, so they
+// produce the same annotations and diagnostics.
+//
+void Expression_class::semant(SemantContext &ctx){
+    if(ctx.iterative){
+        semant_iterative(ctx);
+        return;
     }
-    if(semant_debug){cerr<<"completed class semant for: "<<name<<endl;}
+    Expression child;
+    for(int step = 0; (child = semant_next(ctx, step)) != NULL; step++){
+        child->semant(ctx);
+    }
+    ctx.counters.nodes++;
+    semant_finish(ctx);
 }
 
-/*   This is the entry point to the semantic checker.
+//post-order checking with an explicit stack, for trees too deep to recurse
+void Expression_class::semant_iterative(SemantContext &ctx){
+    std::vector<std::pair<Expression, int> > stack;
+    stack.push_back(std::make_pair((Expression) this, 0));
+    while(!stack.empty()){
+        Expression e = stack.back().first;
+        Expression child = e->semant_next(ctx, stack.back().second++);
+        if(child != NULL){
+            stack.push_back(std::make_pair(child, 0));
+        }else{
+            ctx.counters.nodes++;
+            e->semant_finish(ctx);
+            stack.pop_back();
+        }
+    }
+}
 
-     Your checker should do the following two things:
+//an expression whose type is No_type has already been reported, so the
+//expressions around it take No_type too instead of reporting again
+static bool poisoned(Expression e){
+    return e->get_type() == No_type;
+}
 
-     1) Check that the program is semantically correct
-     2) Decorate the abstract syntax tree with type information
-        by setting the `type' field in each Expression node.
-        (see `tree.h')
+//a declared type that names no class was reported where it was
+//declared; values of that type are treated as poisoned
+static bool undefined_type(SemantContext &ctx, Symbol t){
+    return t != SELF_TYPE && !ctx.classExists(t);
+}
 
-     You are free to first do 1), make sure you catch all semantic
-     errors. Part 2) can be done in a second stage, when you want
-     to build mycoolc.
- */
-void program_class::semant(){
-    initialize_constants();
-    try{
-        //install all classes
-        classtable = new ClassTable(classes);
-        
-        // record attr and methods
-        classtable->initialize_class_contents();
-        
-        // record what children classes have
-        classtable->initialize_inheritance_tree();
-        
-        // make sure that the classes are well formed
-        classtable->validate_classes();
-        
-        // check methods and attributes for problems
-        classtable->validate_features();
-        
-        //if any error cannot be dealt with, move on to the next class
-        for(int i = classes->first(); classes->more(i); i = classes->next(i)) {
-            semant_class = classes->nth(i);
-            try{
-                semant_class->semant();
-            }catch(std::string error_msg){
-                classtable->semant_error(semant_class);
-                cerr << error_msg << endl;
-            }
+Expression isvoid_class::semant_next(SemantContext &ctx, int step){return step == 0 ? e1 : NULL;}
+void isvoid_class::semant_finish(SemantContext &ctx){type=Bool;}
+Expression no_expr_class::semant_next(SemantContext &ctx, int step){return NULL;}
+void no_expr_class::semant_finish(SemantContext &ctx){type=No_type;}
+Expression bool_const_class::semant_next(SemantContext &ctx, int step){return NULL;}
+void bool_const_class::semant_finish(SemantContext &ctx){type = Bool;}
+Expression string_const_class::semant_next(SemantContext &ctx, int step){return NULL;}
+void string_const_class::semant_finish(SemantContext &ctx){type = Str;}
+Expression int_const_class::semant_next(SemantContext &ctx, int step){return NULL;}
+void int_const_class::semant_finish(SemantContext &ctx){type = Int;}
+
+Expression object_class::semant_next(SemantContext &ctx, int step){return NULL;}
+void object_class::semant_finish(SemantContext &ctx){
+    if(name==self){type=SELF_TYPE;}
+    else{
+        Symbol t = ctx.lookup_object(name);
+        if(t==NULL){
+            ctx.semant_error(this, "undefined-object") << "object cannot be found in scope: "<<name<<endl;
+            type=No_type;
+        }else{
+            type = t;
         }
-    }catch(std::string error_msg){
-        classtable->semant_error();
-        cerr << error_msg << endl;
     }
+}
 
-    if (classtable->errors()) {
-	    cerr << "Compilation halted due to static semantic errors." << endl;
-	    //exit(1);
+Expression new__class::semant_next(SemantContext &ctx, int step){return NULL;}
+void new__class::semant_finish(SemantContext &ctx){
+    TRACE_NODE("begin semant in new__class");
+    if(!ctx.classExists(type_name)){
+        ctx.semant_error(this, "undefined-class") << "class: "<<type_name<<" cannot be found"<<endl;
+        type=No_type;
+    }else{
+        type=type_name;
     }
 }
 
-
+//Shared by both kinds of dispatch once the receiver `expr' is checked:
+//find the method in class `t' and check the arity, then each argument as
+//soon as it has been checked itself.  `step' counts from 0 for the method
+//lookup.  Only when the call is well formed are `target', the class that
+//defines it (`target_class') and its dispatch table slot set.
+static Expression dispatch_next(SemantContext &ctx, tree_node *node, int step, Symbol t, Symbol name,
+                                Expressions actual, Feature &target, Symbol &target_class, int &target_slot){
+    if(step == 0){
+        ctx.depends_on(t);
+        if(!ctx.classtable->isRooted(t == SELF_TYPE ? ctx.cls->get_name() : t)){
+            return NULL;
+        }
+        Class_ caller = ctx.getClass(t);
+        Feature method = ctx.classtable->get_method(caller, name);
+        if(method==NULL){
+            ctx.semant_error(node, "undefined-method") << "method: "<<name<<" cannot be found in class: "<<caller->get_name()<<endl;
+            return NULL;
+        }else if(method->get_formals()->len() != actual->len()){
+            ctx.semant_error(node, "wrong-arity") << "method: "<<name<<" has "<<method->get_formals()->len()<<" arguments, but is called with "<<actual->len()<<endl;
+            return NULL;
+        }
+        target = method;
+        target_slot = caller->dispatch_slot(name);
+        target_class = (*caller->dispatch_table())[target_slot].first;
+    }else{
+        int i = step - 1;
+        Symbol ftype = target->get_formals()->nth(i)->get_type();
+        if(!undefined_type(ctx, ftype) && !ctx.inherits(actual->nth(i)->get_type(), ftype)){
+            ctx.semant_error(node, "bad-argument") << "method arg "<<i+1<<" should be of type: "<<ftype<<" but is of type: "<<actual->nth(i)->get_type()<<endl;
+        }
+    }
+    return actual->more(step) ? actual->nth(step) : NULL;
+}
+
+Expression dispatch_class::semant_next(SemantContext &ctx, int step){
+    if(step == 0){
+        TRACE_NODE("begin semant in dispatch_class");
+        target = NULL;
+        target_class = NULL;
+        return expr;
+    }
+    return dispatch_next(ctx, this, step - 1, expr->get_type(), name, actual, target, target_class, target_slot);
+}
+void dispatch_class::semant_finish(SemantContext &ctx){
+    if(target != NULL){
+        Symbol receiver = expr->get_type() == SELF_TYPE ? ctx.cls->get_name() : expr->get_type();
+        monomorphic = ctx.classtable->isMonomorphic(receiver, target_slot);
+        //an override added to or removed from any class below the
+        //receiver changes this, not just the receiver and its ancestors
+        ctx.depends_on(override_table);
+        if(monomorphic){
+            ctx.monomorphic_sites++;
+        }else{
+            ctx.polymorphic_sites++;
+        }
+        Symbol t = target->get_type();
+        if(t==SELF_TYPE){
+            type=expr->get_type();
+        }else if(undefined_type(ctx, t)){
+            type=No_type;
+        }else{
+            type=t;
+        }
+    }else{
+        type=No_type;
+    }
+    TRACE_NODE("finish semant in dispatch_class");
+}
+
+Expression static_dispatch_class::semant_next(SemantContext &ctx, int step){
+    if(step == 0){
+        TRACE_NODE("begin semant in static_dispatch_class");
+        target = NULL;
+        target_class = NULL;
+        return expr;
+    }else if(step == 1 && !ctx.inherits(expr->get_type(), type_name)){
+        ctx.semant_error(this, "bad-static-dispatch") << "type mismatch in static dispatch: "<<endl;
+        return NULL;
+    }
+    return dispatch_next(ctx, this, step - 1, type_name, name, actual, target, target_class, target_slot);
+}
+void static_dispatch_class::semant_finish(SemantContext &ctx){
+    if(target != NULL){
+        Symbol t = target->get_type();
+        if(t==SELF_TYPE){
+            type=expr->get_type();
+        }else if(undefined_type(ctx, t)){
+            type=No_type;
+        }else{
+            type=t;
+        }
+    }else{
+        type=No_type;
+    }
+    TRACE_NODE("finish semant in static_dispatch_class");
+}
+
+//the branches, copied out of their list the first time they are needed,
+//since cases can be very wide and nth walks the list
+std::vector<Case> *typcase_class::branch_list(){
+    if(branches == NULL){
+        branches = new std::vector<Case>;
+        cases->elements(*branches);
+    }
+    return branches;
+}
+
+//each branch is checked in its own scope, which is left when the next
+//branch is asked for
+Expression typcase_class::semant_next(SemantContext &ctx, int step){
+    if(step == 0){
+        TRACE_NODE("begin semant in typcase_class");
+        branch_table = NULL;
+        branch_list();
+        return expr;
+    }else if(step > 1){
+        ctx.scope->exitscope();
+    }
+    return (size_t) step - 1 < branches->size() ? (*branches)[step - 1]->semant_enter(ctx) : NULL;
+}
+
+//Duplicates, unreachable branches and the type of the case each take one
+//pass over the branches, using the class tags: a bit per tag marks the
+//branch types seen so far, a branch matches objects whose tag is in its
+//range, and the join of the branch types is the closest class whose
+//range covers all of theirs.
+void typcase_class::semant_finish(SemantContext &ctx){
+    ClassTable *classtable = ctx.classtable;
+    std::vector<bool> &seen = ctx.branch_seen;
+    std::set<Symbol> seen_untagged;   //classes that do not exist, SELF_TYPE
+    std::vector<ClassTag *> decl(branches->size());
+    bool failed = false, all_self = true, untagged = false;
+    int lo = -1, hi = -1;
+    seen.resize(classtable->class_tags()->size());
+    for(size_t i = 0; i < branches->size(); i++){
+        Case branch = (*branches)[i];
+        decl[i] = classtable->tag_of(branch->get_type_decl());
+        bool duplicate;
+        if(decl[i] != NULL){
+            duplicate = seen[decl[i]->tag];
+            seen[decl[i]->tag] = true;
+        }else{
+            duplicate = !seen_untagged.insert(branch->get_type_decl()).second;
+        }
+        if(duplicate){
+            ctx.semant_error(branch, "duplicate-branch") << "duplicate branch "<<branch->get_type_decl()<<" in case statement"<<endl;
+            failed = true;
+        }
+
+        Expression body = *branch->body_slot();
+        Symbol t = body->get_type();
+        ctx.depends_on(t);
+        ClassTag *body_tag = classtable->tag_of(t == SELF_TYPE ? ctx.cls->get_name() : t);
+        if(poisoned(body)){
+            failed = true;
+        }else if(body_tag == NULL){
+            untagged = true;
+        }else{
+            lo = lo < 0 ? body_tag->tag : std::min(lo, body_tag->tag);
+            hi = std::max(hi, body_tag->tag);
+        }
+        all_self = all_self && t == SELF_TYPE;
+    }
+    for(size_t i = 0; i < branches->size(); i++){
+        if(decl[i] != NULL){
+            seen[decl[i]->tag] = false;
+        }
+    }
+
+    //An object of static type S has a tag in S's range.  A branch whose
+    //range misses it never matches, and of the branches whose range holds
+    //S only the closest to S ever does.
+    Symbol s = expr->get_type();
+    ClassTag *static_tag = poisoned(expr) ? NULL : classtable->tag_of(s == SELF_TYPE ? ctx.cls->get_name() : s);
+    if(static_tag != NULL){
+        int closest = -1;
+        for(size_t i = 0; i < branches->size(); i++){
+            if(decl[i] != NULL && decl[i]->tag <= static_tag->tag && static_tag->tag <= decl[i]->last){
+                closest = std::max(closest, decl[i]->tag);
+            }
+        }
+        for(size_t i = 0; i < branches->size(); i++){
+            Case branch = (*branches)[i];
+            if(decl[i] == NULL){
+                continue;
+            }else if(decl[i]->last < static_tag->tag || decl[i]->tag > static_tag->last){
+                ctx.warning(branch, "unreachable-branch") << "branch "<<branch->get_type_decl()<<" can never match an expression of type "<<s<<endl;
+            }else if(decl[i]->tag < closest){
+                ctx.warning(branch, "unreachable-branch") << "branch "<<branch->get_type_decl()<<" is hidden by the branch for "<<(*classtable->class_tags())[closest].name<<endl;
+            }
+        }
+    }
+
+    if(failed || branches->empty()){
+        type = No_type;
+    }else if(all_self){
+        type = SELF_TYPE;
+    }else if(untagged){
+        type = Object;
+    }else{
+        type = classtable->common_ancestor(lo, hi);
+    }
+    if(type != No_type){
+        ctx.depends_on(tag_table);
+        layout_branches(classtable);
+    }
+}
+
+static bool more_specific(const BranchRange &a, const BranchRange &b){
+    return a.tag > b.tag;
+}
+
+//A class below another has a greater tag, so with the branches in
+//descending tag order the first range that holds an object's tag is the
+//closest ancestor of its class, which is the branch COOL takes.
+void typcase_class::layout_branches(ClassTable *classtable){
+    branch_table = new std::vector<BranchRange>;
+    for(size_t i = 0; i < branches->size(); i++){
+        ClassTag *t = classtable->tag_of((*branches)[i]->get_type_decl());
+        if(t == NULL){
+            branch_table = NULL;
+            return;
+        }
+        BranchRange r;
+        r.tag = t->tag;
+        r.last = t->last;
+        r.branch = i;
+        branch_table->push_back(r);
+    }
+    std::sort(branch_table->begin(), branch_table->end(), more_specific);
+}
+
+Expression let_class::semant_next(SemantContext &ctx, int step){
+    if(step == 0){
+        TRACE_NODE("begin semant in let_class");
+        return init;
+    }else if(step == 1){
+        ctx.enterscope();
+        if(!ctx.classExists(type_decl)){
+            ctx.semant_error(this, "undefined-class") << "type does not exist"<<endl;
+        }else{
+            ctx.addToCurrentScope(this, identifier, type_decl);
+        }
+        return body;
+    }
+    return NULL;
+}
+void let_class::semant_finish(SemantContext &ctx){
+    if(!ctx.inherits(init->get_type(), type_decl)){
+        ctx.semant_error(this, "bad-initializer") << "init type does not inherit declared type"<<endl;
+        type=No_type;
+    }else{
+        type=body->get_type();
+    }
+    ctx.scope->exitscope();
+}
+
+Expression plus_class::semant_next(SemantContext &ctx, int step){
+    if(step == 0){TRACE_NODE("begin semant in plus_class");}
+    return step == 0 ? e1 : step == 1 ? e2 : NULL;
+}
+void plus_class::semant_finish(SemantContext &ctx){
+    if(poisoned(e1) || poisoned(e2)){
+        type=No_type;
+    }else if(e1->get_type() != Int || e2->get_type() != Int){
+        ctx.semant_error(this, "operand-type") << "both arguments for plus must be Ints"<<endl;
+        type=No_type;
+    }else{
+        type=Int;
+    }
+}
+
+Expression eq_class::semant_next(SemantContext &ctx, int step){
+    if(step == 0){TRACE_NODE("begin semant in eq_class");}
+    return step == 0 ? e1 : step == 1 ? e2 : NULL;
+}
+void eq_class::semant_finish(SemantContext &ctx){
+    Symbol e1_type = e1->get_type();
+    Symbol e2_type = e2->get_type();
+    if(poisoned(e1) || poisoned(e2)){
+        type=No_type;
+    }else if((e1_type==Int||e1_type== Bool||e1_type==Str||e2_type==Int||e2_type==Bool||e2_type==Str)
+ 	    &&e1_type!=e2_type){
+        ctx.semant_error(this, "bad-comparison") << "cannot compare with equals the types: "<<e1->get_type()<<" and "<<e2->get_type()<<endl;	
+        type=No_type;
+ 	}else{
+ 	    type=Bool;
+ 	}
+}
+
+Expression mul_class::semant_next(SemantContext &ctx, int step){
+    if(step == 0){TRACE_NODE("begin semant in mul_class");}
+    return step == 0 ? e1 : step == 1 ? e2 : NULL;
+}
+void mul_class::semant_finish(SemantContext &ctx){
+    if(poisoned(e1) || poisoned(e2)){
+        type=No_type;
+    }else if(e1->get_type() != Int || e2->get_type() != Int){
+        ctx.semant_error(this, "operand-type") << "both arguments for multiply must be Ints"<<endl;
+        type=No_type;
+    }else{
+        type=Int;
+    }
+}
+
+Expression divide_class::semant_next(SemantContext &ctx, int step){
+    if(step == 0){TRACE_NODE("begin semant in div_class");}
+    return step == 0 ? e1 : step == 1 ? e2 : NULL;
+}
+void divide_class::semant_finish(SemantContext &ctx){
+    if(poisoned(e1) || poisoned(e2)){
+        type=No_type;
+    }else if(e1->get_type() != Int || e2->get_type() != Int){
+        ctx.semant_error(this, "operand-type") << "both arguments for divide must be Ints"<<endl;
+        type=No_type;
+    }else{
+        type=Int;
+    }
+}
+
+Expression sub_class::semant_next(SemantContext &ctx, int step){
+    if(step == 0){TRACE_NODE("begin semant in sub_class");}
+    return step == 0 ? e1 : step == 1 ? e2 : NULL;
+}
+void sub_class::semant_finish(SemantContext &ctx){
+    if(poisoned(e1) || poisoned(e2)){
+        type=No_type;
+    }else if(e1->get_type() != Int || e2->get_type() != Int){
+        ctx.semant_error(this, "operand-type") << "both arguments for subtract must be Ints"<<endl;
+        type=No_type;
+    }else{
+        type=Int;
+    }
+}
+
+Expression neg_class::semant_next(SemantContext &ctx, int step){
+    if(step == 0){TRACE_NODE("begin semant in neg_class");}
+    return step == 0 ? e1 : NULL;
+}
+void neg_class::semant_finish(SemantContext &ctx){
+    if(poisoned(e1)){
+        type=No_type;
+    }else if(e1->get_type() != Int){
+        ctx.semant_error(this, "operand-type") << "the argument for negation must be an Int"<<endl;
+        type=No_type;
+    }else{
+        type=Int;
+    }
+}
+
+Expression comp_class::semant_next(SemantContext &ctx, int step){
+    if(step == 0){TRACE_NODE("begin semant in comp_class");}
+    return step == 0 ? e1 : NULL;
+}
+void comp_class::semant_finish(SemantContext &ctx){
+    if(poisoned(e1)){
+        type=No_type;
+    }else if(e1->get_type() != Bool){
+        ctx.semant_error(this, "operand-type") << "the argument for complementation must be a Bool"<<endl;
+        type=No_type;
+    }else{
+        type=Bool;
+    }
+}
+
+Expression lt_class::semant_next(SemantContext &ctx, int step){
+    if(step == 0){TRACE_NODE("begin semant in lt_class");}
+    return step == 0 ? e1 : step == 1 ? e2 : NULL;
+}
+void lt_class::semant_finish(SemantContext &ctx){
+    if(poisoned(e1) || poisoned(e2)){
+        type=No_type;
+    }else if(e1->get_type() != Int || e2->get_type() != Int){
+        ctx.semant_error(this, "operand-type") << "both arguments for less than must be Ints"<<endl;
+        type=No_type;
+    }else{
+        type=Bool;
+    }
+}
+
+Expression leq_class::semant_next(SemantContext &ctx, int step){
+    if(step == 0){TRACE_NODE("begin semant in leq_class");}
+    return step == 0 ? e1 : step == 1 ? e2 : NULL;
+}
+void leq_class::semant_finish(SemantContext &ctx){
+    if(poisoned(e1) || poisoned(e2)){
+        type=No_type;
+    }else if(e1->get_type() != Int || e2->get_type() != Int){
+        ctx.semant_error(this, "operand-type") << "both arguments for less than or equals must be Ints"<<endl;
+        type=No_type;
+    }else{
+        type=Bool;
+    }
+}
+
+
+//where the statements are stored, found the first time they are needed,
+//since generated blocks can be very long and nth walks the list
+std::vector<Expression *> *block_class::statement_slots(){
+    if(statements == NULL){
+        statements = new std::vector<Expression *>;
+        body->slots(*statements);
+    }
+    return statements;
+}
+
+Expression block_class::semant_next(SemantContext &ctx, int step){
+    if(step == 0){TRACE_NODE("begin semant in block_class");}
+    std::vector<Expression *> *all = statement_slots();
+    return (size_t) step < all->size() ? *(*all)[step] : NULL;
+}
+void block_class::semant_finish(SemantContext &ctx){
+    if(!statements->empty()){
+        type = (*statements->back())->get_type();
+    }
+}
+
+//opens the scope of the branch and returns its body; typcase closes it
+Expression branch_class::semant_enter(SemantContext &ctx){
+    TRACE_NODE("begin semant in branch_class");
+    ctx.enterscope();
+    if(ctx.classExists(type_decl)){
+        ctx.addToCurrentScope(this, name,type_decl);
+    }else{
+        ctx.semant_error(this, "undefined-class") << "type does not exist: "<<type_decl<<endl;
+    }
+    return expr;
+}
+
+Expression loop_class::semant_next(SemantContext &ctx, int step){
+    if(step == 0){TRACE_NODE("begin semant in loop_class");}
+    return step == 0 ? pred : step == 1 ? body : NULL;
+}
+void loop_class::semant_finish(SemantContext &ctx){
+    if (pred->get_type() != Bool && !poisoned(pred)) {
+        ctx.semant_error(this, "bad-predicate") << "pred must be Bool"<<endl; 
+    }
+    type=Object;
+    //TODO...
+}
+
+
+Expression cond_class::semant_next(SemantContext &ctx, int step){
+    if(step == 0){TRACE_NODE("begin semant in cond_class");}
+    return step == 0 ? pred : step == 1 ? then_exp : step == 2 ? else_exp : NULL;
+}
+void cond_class::semant_finish(SemantContext &ctx){
+    if (pred->get_type() != Bool && !poisoned(pred)) {
+        ctx.semant_error(this, "bad-predicate") << "condition must have type Bool"<<endl;
+        type=No_type;
+    }else if(poisoned(then_exp) || poisoned(else_exp)){
+        type=No_type;
+    }else{
+        type=ctx.lub(then_exp->get_type(), else_exp->get_type());
+    }
+}
+
+Expression assign_class::semant_next(SemantContext &ctx, int step){
+    if(step == 0){TRACE_NODE("begin semant in assign_class");}
+    return step == 0 ? expr : NULL;
+}
+void assign_class::semant_finish(SemantContext &ctx){
+    Symbol assign_type = ctx.lookup_object(name);
+    if(assign_type==NULL){
+        ctx.semant_error(this, "undefined-object") << "assign type does not exist"<<endl;
+        type=No_type;
+    }else if(!ctx.inherits(expr->get_type(), assign_type)){
+        ctx.semant_error(this, "bad-assignment") << "assignment inheritance problem"<<endl;     
+        type=No_type;
+    }else{
+        type=expr->get_type();
+    }
+    TRACE_NODE("complete semant in assign_class");
+}
+
+
+
+void formal_class::semant(SemantContext &ctx){
+    TRACE_NODE("begin semant in formal_class");
+    if(type_decl == SELF_TYPE){
+        ctx.warning(this, "self-type-formal") << "formal has type==SELF_TYPE"<<endl;
+    }
+    if(!ctx.classExists(type_decl)){
+        ctx.semant_error(this, "undefined-class") << "class in formal does not exist"<<endl; 
+    }else{
+        ctx.addToCurrentScope(this, name,type_decl);
+    }
+}
+
+void method_class::semant(SemantContext &ctx){
+    TraceSpan span(ctx.cls->get_name(), name);
+    TRACE_FEATURE("begin semant in method_class:", name);
+    //enter the scope of the method
+    ctx.enterscope();
+    
+    //call semant on child nodes
+    for(int i = formals->first(); formals->more(i); i = formals->next(i)) {
+        formals->nth(i)->semant(ctx);
+    }
+    expr->semant(ctx);
+    bool undefined = undefined_type(ctx, return_type);
+    if(undefined){
+        ctx.semant_error(this, "undefined-class") << "return type of method does not exist: "<<return_type<<endl;
+    }
+    
+    //check validity of expr
+    Symbol t = expr->get_type();
+    TRACE_FEATURE("checking method return:", t, return_type);
+    if(!undefined && !ctx.inherits(t, return_type)){
+        ctx.warning(this, "bad-return") << "expr in method has bad type"<<endl;
+    }
+    
+    ctx.scope->exitscope();
+    TRACE_FEATURE("completed method semant for:", name);
+}
+
+void attr_class::semant(SemantContext &ctx){
+    TRACE_FEATURE("begin semant in attr_class:", name);
+    //call semant on the expression
+    init->semant(ctx);
+    bool undefined = undefined_type(ctx, type_decl);
+    if(undefined){
+        ctx.semant_error(this, "undefined-class") << "class of attribute does not exist: "<<type_decl<<endl;
+    }
+    
+    //verify that the expression type inherits the declared type
+    Symbol t = init->get_type();
+    TRACE_FEATURE("checking attr initializer:", t, type_decl);
+    if(!undefined && !ctx.inherits(t, type_decl)){
+        ctx.warning(this, "bad-initializer") << "attribute type mismatch"<<endl;
+    }
+    TRACE_FEATURE("completed attr semant for:", name);
+}
+
+void class__class::semant(SemantContext &ctx){
+    TraceSpan span(name, NULL);
+    TRACE_CLASS("begin semant in class__class:", name);
+    for(int i = features->first(); features->more(i); i = features->next(i)) {
+        features->nth(i)->semant(ctx);
+    }
+    TRACE_CLASS("completed class semant for:", name);
+}
+
+
+///////////////////////////////////////folding////////////////////////////////////////
+//
+// Under -O the typed tree is simplified before it is dumped: arithmetic,
+// comparisons and complements of constants are replaced by their value,
+// conditionals on a constant take their branch, and identities such as
+// x + 0 or not not b drop the operation.  A node is only replaced by one
+// of the same type, and only nodes that type checked are touched.
+//
+// fold_next(step) returns where the next child is stored, or NULL once
+// all have been visited; simplify() returns the node that should take
+// the place of an expression whose children are already folded.
+//
+
+//Folded results are not interned as they are made: in a long chain of
+//constants each one is used once by the next operation and dropped, and
+//interning them all would be quadratic and leave every one of them in
+//the int table.  A result keeps its value in the node until the fold is
+//over, and then only the constants still in the tree are interned.
+
+long long int_const_class::get_value(){
+    return token != NULL ? atoll(token->get_string()) : value;
+}
+
+void int_const_class::intern(){
+    if(token == NULL){
+        AllocScope alloc(ALLOC_STRINGS);
+        token = inttable.add_int((int) value);
+    }
+}
+
+//whether `e' is a constant made by folding, or the negation of one
+static bool uninterned_constant(Expression e){
+    neg_class *n = dynamic_cast<neg_class *>(e);
+    int_const_class *c = dynamic_cast<int_const_class *>(n != NULL ? n->get_operand() : e);
+    return c != NULL && c->get_token() == NULL;
+}
+
+//interns the folded constants left in the tree, walking it with the
+//same steps as folding
+static void intern_constants(Expression root){
+    std::vector<std::pair<Expression, int> > stack;
+    stack.push_back(std::make_pair(root, 0));
+    while(!stack.empty()){
+        Expression e = stack.back().first;
+        Expression *child = e->fold_next(stack.back().second++);
+        if(child != NULL){
+            stack.push_back(std::make_pair(*child, 0));
+        }else{
+            int_const_class *c = dynamic_cast<int_const_class *>(e);
+            if(c != NULL){
+                c->intern();
+            }
+            stack.pop_back();
+        }
+    }
+}
+
+Expression Expression_class::fold(){
+    Expression root = this;
+    int made = 0;   // constants made by this fold, interned at the end
+    std::vector<std::pair<Expression *, int> > stack;
+    stack.push_back(std::make_pair(&root, 0));
+    while(!stack.empty()){
+        Expression *slot = stack.back().first;
+        Expression *child = (*slot)->fold_next(stack.back().second++);
+        if(child != NULL){
+            stack.push_back(std::make_pair(child, 0));
+        }else{
+            Expression folded = (*slot)->simplify();
+            if(folded != *slot && uninterned_constant(folded)){
+                made++;
+            }
+            *slot = folded;
+            stack.pop_back();
+        }
+    }
+    if(made > 0){
+        intern_constants(root);
+    }
+    return root;
+}
+
+Expression *isvoid_class::fold_next(int step){return step == 0 ? &e1 : NULL;}
+Expression *no_expr_class::fold_next(int step){return NULL;}
+Expression *bool_const_class::fold_next(int step){return NULL;}
+Expression *string_const_class::fold_next(int step){return NULL;}
+Expression *int_const_class::fold_next(int step){return NULL;}
+Expression *object_class::fold_next(int step){return NULL;}
+Expression *new__class::fold_next(int step){return NULL;}
+Expression *dispatch_class::fold_next(int step){
+    return step == 0 ? &expr : actual->more(step - 1) ? actual->nth_slot(step - 1) : NULL;
+}
+Expression *static_dispatch_class::fold_next(int step){
+    return step == 0 ? &expr : actual->more(step - 1) ? actual->nth_slot(step - 1) : NULL;
+}
+Expression *typcase_class::fold_next(int step){
+    return step == 0 ? &expr : (size_t) step - 1 < branch_list()->size() ? (*branches)[step - 1]->body_slot() : NULL;
+}
+Expression *let_class::fold_next(int step){return step == 0 ? &init : step == 1 ? &body : NULL;}
+Expression *plus_class::fold_next(int step){return step == 0 ? &e1 : step == 1 ? &e2 : NULL;}
+Expression *sub_class::fold_next(int step){return step == 0 ? &e1 : step == 1 ? &e2 : NULL;}
+Expression *mul_class::fold_next(int step){return step == 0 ? &e1 : step == 1 ? &e2 : NULL;}
+Expression *divide_class::fold_next(int step){return step == 0 ? &e1 : step == 1 ? &e2 : NULL;}
+Expression *eq_class::fold_next(int step){return step == 0 ? &e1 : step == 1 ? &e2 : NULL;}
+Expression *lt_class::fold_next(int step){return step == 0 ? &e1 : step == 1 ? &e2 : NULL;}
+Expression *leq_class::fold_next(int step){return step == 0 ? &e1 : step == 1 ? &e2 : NULL;}
+Expression *neg_class::fold_next(int step){return step == 0 ? &e1 : NULL;}
+Expression *comp_class::fold_next(int step){return step == 0 ? &e1 : NULL;}
+Expression *block_class::fold_next(int step){
+    return (size_t) step < statement_slots()->size() ? (*statements)[step] : NULL;
+}
+Expression *loop_class::fold_next(int step){return step == 0 ? &pred : step == 1 ? &body : NULL;}
+Expression *cond_class::fold_next(int step){
+    return step == 0 ? &pred : step == 1 ? &then_exp : step == 2 ? &else_exp : NULL;
+}
+Expression *assign_class::fold_next(int step){return step == 0 ? &expr : NULL;}
+
+//the value of an Int constant, or of the negation of one
+static bool int_value(Expression e, long long &v){
+    neg_class *n = dynamic_cast<neg_class *>(e);
+    int_const_class *c = dynamic_cast<int_const_class *>(n != NULL ? n->get_operand() : e);
+    if(c == NULL){
+        return false;
+    }
+    v = c->get_value();
+    if(n != NULL){
+        v = -v;
+    }
+    return true;
+}
+
+static bool bool_value(Expression e, bool &v){
+    bool_const_class *c = dynamic_cast<bool_const_class *>(e);
+    if(c == NULL){
+        return false;
+    }
+    v = c->get_val();
+    return true;
+}
+
+//a new Int constant in place of `node', or NULL if `v' does not fit in
+//the 32 bits of a COOL Int (the operation is then left for run time).
+//Integer literals have no sign, so a negative value is the negation of
+//its magnitude.
+static Expression int_result(Expression node, long long v){
+    if(v < -2147483647LL || v > 2147483647LL){
+        return NULL;
+    }
+    int_const_class *c = (int_const_class *) int_const(NULL);
+    c->set_value(v < 0 ? -v : v);
+    Expression e = c;
+    e->set(node);
+    e->set_type(Int);
+    if(v < 0){
+        e = neg(e);
+        e->set(node);
+        e->set_type(Int);
+    }
+    return e;
+}
+
+static Expression bool_result(Expression node, bool v){
+    Expression e = bool_const(v);
+    e->set(node);
+    return e->set_type(Bool);
+}
+
+Expression plus_class::simplify(){
+    long long a, b;
+    bool ca = int_value(e1, a), cb = int_value(e2, b);
+    Expression folded = NULL;
+    if(type != Int){
+        return this;
+    }else if(ca && cb){
+        folded = int_result(this, a + b);
+    }else if(ca && a == 0){
+        folded = e2;
+    }else if(cb && b == 0){
+        folded = e1;
+    }
+    return folded != NULL ? folded : this;
+}
+
+Expression sub_class::simplify(){
+    long long a, b;
+    bool ca = int_value(e1, a), cb = int_value(e2, b);
+    Expression folded = NULL;
+    if(type != Int){
+        return this;
+    }else if(ca && cb){
+        folded = int_result(this, a - b);
+    }else if(cb && b == 0){
+        folded = e1;
+    }
+    return folded != NULL ? folded : this;
+}
+
+Expression mul_class::simplify(){
+    long long a, b;
+    bool ca = int_value(e1, a), cb = int_value(e2, b);
+    Expression folded = NULL;
+    if(type != Int){
+        return this;
+    }else if(ca && cb){
+        folded = int_result(this, a * b);
+    }else if(ca && a == 1){
+        folded = e2;
+    }else if(cb && b == 1){
+        folded = e1;
+    }
+    return folded != NULL ? folded : this;
+}
+
+//division by zero is left alone, so that it still fails at run time
+Expression divide_class::simplify(){
+    long long a, b;
+    bool ca = int_value(e1, a), cb = int_value(e2, b);
+    Expression folded = NULL;
+    if(type != Int){
+        return this;
+    }else if(ca && cb && b != 0){
+        folded = int_result(this, a / b);
+    }else if(cb && b == 1){
+        folded = e1;
+    }
+    return folded != NULL ? folded : this;
+}
+
+//~n is how a negative constant is written, so it is left as it is
+Expression neg_class::simplify(){
+    long long a;
+    Expression folded = NULL;
+    if(type != Int || dynamic_cast<int_const_class *>(e1) != NULL){
+        return this;
+    }else if(int_value(e1, a)){
+        folded = int_result(this, -a);
+    }else if(dynamic_cast<neg_class *>(e1) != NULL){
+        folded = ((neg_class *) e1)->get_operand();
+    }
+    return folded != NULL ? folded : this;
+}
+
+Expression lt_class::simplify(){
+    long long a, b;
+    if(type == Bool && int_value(e1, a) && int_value(e2, b)){
+        return bool_result(this, a < b);
+    }
+    return this;
+}
+
+Expression leq_class::simplify(){
+    long long a, b;
+    if(type == Bool && int_value(e1, a) && int_value(e2, b)){
+        return bool_result(this, a <= b);
+    }
+    return this;
+}
+
+//constants of the basic classes are compared by value; string constants
+//are interned, so equal strings are the same symbol
+Expression eq_class::simplify(){
+    long long a, b;
+    bool p, q;
+    string_const_class *s1 = dynamic_cast<string_const_class *>(e1);
+    string_const_class *s2 = dynamic_cast<string_const_class *>(e2);
+    if(type != Bool){
+        return this;
+    }else if(int_value(e1, a) && int_value(e2, b)){
+        return bool_result(this, a == b);
+    }else if(bool_value(e1, p) && bool_value(e2, q)){
+        return bool_result(this, p == q);
+    }else if(s1 != NULL && s2 != NULL){
+        return bool_result(this, s1->get_token() == s2->get_token());
+    }
+    return this;
+}
+
+Expression comp_class::simplify(){
+    bool p;
+    if(type != Bool){
+        return this;
+    }else if(bool_value(e1, p)){
+        return bool_result(this, !p);
+    }else if(dynamic_cast<comp_class *>(e1) != NULL){
+        return ((comp_class *) e1)->e1;
+    }
+    return this;
+}
+
+//the branch taken replaces the conditional only if it has the same type
+Expression cond_class::simplify(){
+    bool p;
+    if(type == No_type || !bool_value(pred, p)){
+        return this;
+    }
+    Expression taken = p ? then_exp : else_exp;
+    return taken->get_type() == type ? taken : this;
+}
+
+void method_class::fold(){expr = expr->fold();}
+void attr_class::fold(){init = init->fold();}
+
+//folding interns new constants, so it runs on one thread at a time
+static void fold_class(Class_ c){
+    Features features = c->getFeatures();
+    for(int i = features->first(); features->more(i); i = features->next(i)) {
+        features->nth(i)->fold();
+    }
+}
+
+
+///////////////////////////////////////reachability////////////////////////////////////////
+//
+// Under -D the classes and methods that cannot be used from Main.main are
+// removed from the typed tree.  Each Feature and Expression reports what
+// it uses through reach(); visit() takes an expression tree apart with
+// the same fold_next() steps as folding.
+//
+void Reachability::keep_class(Symbol name){
+    //SELF_TYPE, No_type and prim_slot are not classes
+    if(relinking || !classtable->isRooted(name)){
+        return;
+    }
+    for(Symbol a = name; !kept_classes.count(a); a = classtable->getClass(a)->get_parent()){
+        kept_classes.insert(a);
+        //the initializers of a class that is kept are compiled, whether
+        //or not it is ever instantiated
+        Class_ c = classtable->getClass(a);
+        Features features = c->getFeatures();
+        for(int i = features->first(); features->more(i); i = features->next(i)) {
+            if(!features->nth(i)->isMethod()){
+                pending.push_back(std::make_pair(c, features->nth(i)));
+            }
+        }
+        if(a == Object){
+            break;
+        }
+    }
+}
+
+void Reachability::reach_method(Symbol owner, Symbol name){
+    if(relinking || !reached_methods.insert(std::make_pair(owner, name)).second){
+        return;
+    }
+    keep_class(owner);
+    Class_ c = classtable->getClass(owner);
+    std::map<Symbol, Feature>::iterator it = c->mtable()->find(name);
+    if(it != c->mtable()->end()){
+        pending.push_back(std::make_pair(c, it->second));
+    }
+}
+
+//a dynamic dispatch through `slot' on a receiver of static class
+//`receiver' may reach the method in that slot of any class below it
+void Reachability::reach_dispatch(Symbol receiver, int slot){
+    if(relinking || !dispatched.insert(std::make_pair(receiver, slot)).second){
+        return;
+    }
+    std::vector<Class_> stack(1, classtable->getClass(receiver));
+    while(!stack.empty()){
+        Class_ c = stack.back();
+        stack.pop_back();
+        std::pair<Symbol, Symbol> entry = (*c->dispatch_table())[slot];
+        reach_method(entry.first, entry.second);
+        std::list<Class_> *children = classtable->getChildren(c->get_name());
+        for(std::list<Class_>::iterator it = children->begin(); it != children->end(); it++){
+            stack.push_back(*it);
+        }
+    }
+}
+
+void Reachability::visit(Expression e){
+    std::vector<Expression> stack(1, e);
+    while(!stack.empty()){
+        Expression next = stack.back();
+        stack.pop_back();
+        keep_class(next->get_type());
+        next->reach(*this);
+        Expression *child;
+        for(int step = 0; (child = next->fold_next(step)) != NULL; step++){
+            stack.push_back(*child);
+        }
+    }
+}
+
+//Main is instantiated to run the program, and its main method called
+void Reachability::run(){
+    if(!classtable->isRooted(Main)){
+        return;
+    }
+    keep_class(Main);
+    Class_ main_class = classtable->getClass(Main);
+    int slot = main_class->dispatch_slot(main_meth);
+    if(slot >= 0){
+        reach_method((*main_class->dispatch_table())[slot].first, main_meth);
+    }
+    while(!pending.empty()){
+        std::pair<Class_, Feature> next = pending.back();
+        pending.pop_back();
+        cls = next.first;
+        next.second->reach(*this);
+    }
+}
+
+void Reachability::relink(){
+    relinking = true;
+    for(std::set<Symbol>::iterator it = kept_classes.begin(); it != kept_classes.end(); it++){
+        cls = classtable->getClass(*it);
+        Features features = cls->getFeatures();
+        for(int i = features->first(); features->more(i); i = features->next(i)) {
+            features->nth(i)->reach(*this);
+        }
+    }
+}
+
+void method_class::reach(Reachability &r){
+    for(int i = formals->first(); formals->more(i); i = formals->next(i)) {
+        r.keep_class(formals->nth(i)->get_type());
+    }
+    r.keep_class(return_type);
+    r.visit(expr);
+}
+
+void attr_class::reach(Reachability &r){
+    r.keep_class(type_decl);
+    r.visit(init);
+}
+
+void dispatch_class::reach(Reachability &r){
+    if(target == NULL){
+        return;
+    }
+    Symbol receiver = expr->get_type() == SELF_TYPE ? r.cls->get_name() : expr->get_type();
+    if(r.relinking){
+        target_slot = r.classtable->getClass(receiver)->dispatch_slot(name);
+        monomorphic = r.classtable->isMonomorphic(receiver, target_slot);
+    }else{
+        r.reach_dispatch(receiver, target_slot);
+    }
+}
+
+void static_dispatch_class::reach(Reachability &r){
+    if(target == NULL){
+        return;
+    }
+    if(r.relinking){
+        target_slot = r.classtable->getClass(type_name)->dispatch_slot(name);
+    }else{
+        r.keep_class(type_name);
+        r.reach_method(target_class, name);
+    }
+}
+
+void new__class::reach(Reachability &r){r.keep_class(type_name);}
+void let_class::reach(Reachability &r){r.keep_class(type_decl);}
+void typcase_class::reach(Reachability &r){
+    if(r.relinking){
+        if(branch_table != NULL){
+            layout_branches(r.classtable);
+        }
+        return;
+    }
+    std::vector<Case> *all = branch_list();
+    for(size_t i = 0; i < all->size(); i++){
+        r.keep_class((*all)[i]->get_type_decl());
+    }
+}
+
+//only the methods that were reached stay; attributes are part of the
+//object layout and are all kept
+void class__class::prune_methods(Reachability &r){
+    Features kept = nil_Features();
+    for(int i = features->first(); features->more(i); i = features->next(i)) {
+        Feature f = features->nth(i);
+        if(!f->isMethod() || r.reached(name, f->get_name())){
+            kept = append_Features(kept, single_Features(f));
+        }
+    }
+    features = kept;
+}
+
+//checks one class with the given context
+static void semant_one_class(SemantContext &ctx, Class_ c){
+    double start = semant_stats ? stats_now_ms() : 0;
+    ctx.enter_class(c);
+    c->semant(ctx);
+    if(semant_stats){
+        stats_add_class(c->get_name(), stats_now_ms() - start);
+    }
+}
+
+//A worker's share of the checking tasks.  The owner takes tasks from the
+//back, idle workers steal from the front, so a thief takes the work the
+//owner would reach last.
+class TaskDeque {
+private:
+    std::deque<size_t> tasks;
+    std::mutex lock;
+public:
+    void push(size_t t){
+        std::lock_guard<std::mutex> guard(lock);
+        tasks.push_back(t);
+    }
+    bool pop(size_t &t){
+        std::lock_guard<std::mutex> guard(lock);
+        if(tasks.empty()){
+            return false;
+        }
+        t = tasks.back();
+        tasks.pop_back();
+        return true;
+    }
+    bool steal(size_t &t){
+        std::lock_guard<std::mutex> guard(lock);
+        if(tasks.empty()){
+            return false;
+        }
+        t = tasks.front();
+        tasks.pop_front();
+        return true;
+    }
+};
+
+//checks every method and attribute as a task of its own, so that one huge
+//class spreads over all the workers, one worker per context.  Tasks are
+//dealt out to the workers in contiguous runs and rebalanced by stealing.
+//Each task gets fresh scopes on top of the class attribute tables and its
+//own diagnostic sink; the sinks are appended to `out' in source order once
+//every worker has finished, so the output does not depend on the schedule.
+static void semant_features_parallel(std::vector<SemantContext *> &contexts, std::vector<Class_> &cls, DiagnosticSink& out){
+    std::vector<Class_> task_class;
+    std::vector<Feature> task_feature;
+    for(size_t c = 0; c < cls.size(); c++){
+        Features features = cls[c]->getFeatures();
+        for(int i = features->first(); features->more(i); i = features->next(i)){
+            task_class.push_back(cls[c]);
+            task_feature.push_back(features->nth(i));
+        }
+    }
+    size_t ntasks = task_feature.size();
+    size_t workers = contexts.size() < ntasks ? contexts.size() : ntasks;
+    if(workers == 0){
+        return;
+    }
+
+    std::vector<DiagnosticSink> task_out(ntasks);
+    std::vector<TaskDeque> deques(workers);
+    for(size_t t = 0; t < ntasks; t++){
+        deques[t * workers / ntasks].push(t);
+    }
+
+    std::vector<std::thread> pool;
+    for(size_t w = 0; w < workers; w++){
+        pool.push_back(std::thread([&, w](){
+            SemantContext &ctx = *contexts[w];
+            AllocScope alloc(ALLOC_CHECKER);
+            //a class's tasks may be split between workers, so each worker
+            //traces a class span around every run of them it checks
+            Class_ run_class = NULL;
+            double run_start = 0;
+            size_t t;
+            for(;;){
+                bool found = deques[w].pop(t);
+                for(size_t v = 1; !found && v < workers; v++){
+                    found = deques[(w + v) % workers].steal(t);
+                }
+                if(semant_trace_file != NULL && (!found || task_class[t] != run_class)){
+                    double now = stats_now_ms();
+                    if(run_class != NULL){
+                        trace_add_class(run_class->get_name(), run_start, now);
+                    }
+                    run_class = found ? task_class[t] : NULL;
+                    run_start = now;
+                }
+                //no task ever creates another, so empty deques mean we are done
+                if(!found){
+                    break;
+                }
+                double start = semant_stats ? stats_now_ms() : 0;
+                ctx.diagnostics = &task_out[t];
+                ctx.enter_class(task_class[t]);
+                task_feature[t]->semant(ctx);
+                if(semant_stats){
+                    stats_add_class(task_class[t]->get_name(), stats_now_ms() - start);
+                }
+            }
+        }));
+    }
+    for(size_t w = 0; w < pool.size(); w++){
+        pool[w].join();
+    }
+
+    for(size_t t = 0; t < ntasks; t++){
+        out.append(task_out[t]);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// Incremental checking
+//
+// With -I, what was learned about each class is kept in a state file
+// between runs: a fingerprint of its signature (parent, attribute types,
+// method signatures), a fingerprint of its whole body, the classes its
+// checks looked at, its diagnostics and its typed dump.  A class is
+// checked again only if its body changed or if the signature of one of
+// the classes it depends on did; otherwise its diagnostics are replayed
+// and its dump is reused.  The class table and the class-level checks are
+// always redone, since they are cheap next to the expression checks.
+//
+//////////////////////////////////////////////////////////////////////
+#define STATE_VERSION "semant-state 3"
+
+struct ClassRecord {
+    unsigned long long signature;
+    unsigned long long body;
+    std::set<Symbol> depends;
+    std::vector<Diagnostic> diagnostics;
+    std::string typed_dump;
+};
+
+struct IncrementalState {
+    std::map<Symbol, unsigned long long> signatures;  // every user class
+    std::map<Symbol, ClassRecord> classes;            // the ones that were checked
+};
+
+// 64 bit FNV-1a
+static unsigned long long fingerprint(const std::string &text){
+    unsigned long long h = 14695981039346656037ULL;
+    for(size_t i = 0; i < text.size(); i++){
+        h = (h ^ (unsigned char) text[i]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+static unsigned long long signature_fingerprint(Class_ c){
+    std::ostringstream sig;
+    sig << c->get_name() << " " << c->get_parent() << "\n";
+    Features features = c->getFeatures();
+    for(int i = features->first(); features->more(i); i = features->next(i)){
+        Feature f = features->nth(i);
+        sig << f->get_name();
+        if(f->isMethod()){
+            Formals formals = f->get_formals();
+            sig << "(";
+            for(int j = formals->first(); formals->more(j); j = formals->next(j)){
+                sig << formals->nth(j)->get_type() << ",";
+            }
+            sig << ")";
+        }
+        sig << ":" << f->get_type() << "\n";
+    }
+    return fingerprint(sig.str());
+}
+
+//The class is dumped with types, whose walk over expressions does not
+//recurse, and without the annotations, which depend on how far the
+//checker has got rather than on the source.
+static unsigned long long body_fingerprint(Class_ c){
+    std::ostringstream body;
+    int annotate = semant_annotate;
+    semant_annotate = 0;
+    c->dump_with_types(body, 0);
+    semant_annotate = annotate;
+    return fingerprint(body.str());
+}
+
+static void write_sized(ostream& out, const std::string &s){
+    out << s.size() << " " << s;
+}
+
+static bool read_sized(std::istream& in, std::string &s){
+    size_t n;
+    if(!(in >> n) || in.get() != ' '){
+        return false;
+    }
+    s.resize(n);
+    return n == 0 || (bool) in.read(&s[0], n);
+}
+
+//options that change what is recorded; a state written under others is ignored
+static std::string state_config(){
+    std::ostringstream config;
+    config << "O" << cgen_optimize << "A" << semant_annotate;
+    return config.str();
+}
+
+//a name read back from a state file, interned as the reader would
+template <class Table>
+static Symbol state_symbol(Table &table, const std::string &text){
+    AllocScope alloc(ALLOC_STRINGS);
+    return table.add_string((char *) text.c_str());
+}
+
+//an unreadable or foreign state file is treated as empty
+static IncrementalState load_state(const char *path){
+    IncrementalState state, empty;
+    std::ifstream in(path, std::ios::binary);
+    std::string line;
+    if(!std::getline(in, line) || line != STATE_VERSION " " + state_config()){
+        return empty;
+    }
+    std::string tag;
+    while(in >> tag){
+        std::string name;
+        if(tag == "sig"){
+            unsigned long long sig;
+            if(!(in >> name >> std::hex >> sig >> std::dec)){
+                return empty;
+            }
+            state.signatures[state_symbol(idtable, name)] = sig;
+        }else if(tag == "class"){
+            ClassRecord r;
+            if(!(in >> name >> std::hex >> r.signature >> r.body >> std::dec)){
+                return empty;
+            }
+            Symbol cname = state_symbol(idtable, name);
+            Symbol filename = NULL;
+            std::string file;
+            if(!(in >> tag) || tag != "file" || !read_sized(in, file)){
+                return empty;
+            }
+            filename = state_symbol(stringtable, file);
+            while(in >> tag && tag != "end"){
+                std::string text;
+                if(tag == "dep" && in >> text){
+                    r.depends.insert(state_symbol(idtable, text));
+                }else if(tag == "diag"){
+                    Diagnostic d;
+                    d.filename = filename;
+                    d.class_name = cname;
+                    if(!(in >> d.line >> d.error >> d.code) || in.get() != ' ' || !read_sized(in, d.message)){
+                        return empty;
+                    }
+                    r.diagnostics.push_back(d);
+                }else if(tag == "dump" && in.get() == ' ' && read_sized(in, r.typed_dump)){
+                    continue;
+                }else{
+                    return empty;
+                }
+            }
+            if(tag != "end"){
+                return empty;
+            }
+            state.classes[cname] = r;
+        }else{
+            return empty;
+        }
+    }
+    return state;
+}
+
+//written next to the old file and renamed over it, so a run that dies
+//half way leaves the previous state intact
+static void save_state(const char *path, IncrementalState &state){
+    std::string tmp = std::string(path) + ".tmp";
+    std::ofstream out(tmp.c_str(), std::ios::binary);
+    out << STATE_VERSION " " << state_config() << "\n";
+    for(std::map<Symbol, unsigned long long>::iterator it = state.signatures.begin(); it != state.signatures.end(); it++){
+        out << "sig " << it->first << " " << std::hex << it->second << std::dec << "\n";
+    }
+    for(std::map<Symbol, ClassRecord>::iterator it = state.classes.begin(); it != state.classes.end(); it++){
+        ClassRecord &r = it->second;
+        out << "class " << it->first << " " << std::hex << r.signature << " " << r.body << std::dec << "\n";
+        out << "file ";
+        write_sized(out, r.diagnostics.empty() ? std::string() : r.diagnostics[0].filename->get_string());
+        out << "\n";
+        for(std::set<Symbol>::iterator d = r.depends.begin(); d != r.depends.end(); d++){
+            out << "dep " << *d << "\n";
+        }
+        for(size_t i = 0; i < r.diagnostics.size(); i++){
+            Diagnostic &d = r.diagnostics[i];
+            out << "diag " << d.line << " " << d.error << " " << d.code << " ";
+            write_sized(out, d.message);
+            out << "\n";
+        }
+        out << "dump ";
+        write_sized(out, r.typed_dump);
+        out << "\nend\n";
+    }
+    out.close();
+    if(!out || rename(tmp.c_str(), path) != 0){
+        cerr << "could not write incremental state to " << path << endl;
+    }
+}
+
+//checks only the classes that changed or depend on a changed signature.
+//`all' is every installed user class, `checkable' those that descend from
+//Object.
+static void semant_incremental(SemantContext &ctx, std::vector<Class_> &all, std::vector<Class_> &checkable){
+    ClassTable *classtable = ctx.classtable;
+    IncrementalState old = load_state(semant_incremental_state);
+    IncrementalState now;
+    for(size_t i = 0; i < all.size(); i++){
+        now.signatures[all[i]->get_name()] = signature_fingerprint(all[i]);
+    }
+    //branch tables in the dump hold class tags, which any class added,
+    //removed or moved in the tree can change
+    if(semant_annotate){
+        std::ostringstream tags;
+        std::vector<ClassTag> *order = classtable->class_tags();
+        for(size_t i = 0; i < order->size(); i++){
+            tags << (*order)[i].name << " " << (*order)[i].tag << " " << (*order)[i].last << "\n";
+        }
+        now.signatures[tag_table] = fingerprint(tags.str());
+
+        //so do the monomorphic flags on dispatches, with the overrides
+        //anywhere below the receiver
+        std::ostringstream overrides;
+        for(size_t i = 0; i < order->size(); i++){
+            Symbol name = (*order)[i].name;
+            overrides << name << " ";
+            for(size_t slot = 0; slot < classtable->getClass(name)->dispatch_table()->size(); slot++){
+                overrides << (classtable->isMonomorphic(name, slot) ? '0' : '1');
+            }
+            overrides << "\n";
+        }
+        now.signatures[override_table] = fingerprint(overrides.str());
+    }
+
+    //classes that appeared, disappeared or changed their signature
+    std::set<Symbol> changed;
+    for(std::map<Symbol, unsigned long long>::iterator it = now.signatures.begin(); it != now.signatures.end(); it++){
+        std::map<Symbol, unsigned long long>::iterator o = old.signatures.find(it->first);
+        if(o == old.signatures.end() || o->second != it->second){
+            changed.insert(it->first);
+        }
+    }
+    for(std::map<Symbol, unsigned long long>::iterator o = old.signatures.begin(); o != old.signatures.end(); o++){
+        if(now.signatures.find(o->first) == now.signatures.end()){
+            changed.insert(o->first);
+        }
+    }
+
+    int rechecked = 0;
+    for(size_t i = 0; i < checkable.size(); i++){
+        Class_ c = checkable[i];
+        Symbol name = c->get_name();
+        ClassRecord &r = now.classes[name];
+        r.signature = now.signatures[name];
+        r.body = body_fingerprint(c);
+
+        std::map<Symbol, ClassRecord>::iterator o = old.classes.find(name);
+        bool reuse = o != old.classes.end() && o->second.body == r.body && !changed.count(name);
+        if(reuse){
+            for(std::set<Symbol>::iterator d = o->second.depends.begin(); d != o->second.depends.end(); d++){
+                if(changed.count(*d)){
+                    reuse = false;
+                    break;
+                }
+            }
+        }
+
+        if(reuse){
+            r = o->second;
+            for(size_t j = 0; j < r.diagnostics.size(); j++){
+                classtable->replay(r.diagnostics[j]);
+            }
+            c->reuse_dump(new std::string(r.typed_dump));
+            continue;
+        }
+
+        rechecked++;
+        DiagnosticSink sink;
+        ctx.diagnostics = &sink;
+        ctx.depends = &r.depends;
+        semant_one_class(ctx, c);
+        r.diagnostics = sink.get_records();
+        classtable->get_diagnostics().append(sink);
+
+        //a class depends on the ancestors of everything it looked at, and
+        //on its own, since that is where inherited features come from
+        std::set<Symbol> looked_at = r.depends;
+        looked_at.insert(name);
+        for(std::set<Symbol>::iterator d = looked_at.begin(); d != looked_at.end(); d++){
+            for(Symbol a = *d; classtable->isRooted(a) && a != Object; a = classtable->getClass(a)->get_parent()){
+                r.depends.insert(a);
+            }
+        }
+        r.depends.erase(name);
+        if(cgen_optimize){
+            fold_class(c);
+        }
+        std::ostringstream dump;
+        c->dump_with_types(dump, 2);
+        r.typed_dump = dump.str();
+    }
+    ctx.diagnostics = &classtable->get_diagnostics();
+    ctx.depends = NULL;
+
+    if(semant_debug){cerr<<"incremental: rechecked "<<rechecked<<" of "<<checkable.size()<<" classes"<<endl;}
+    save_state(semant_incremental_state, now);
+}
+
+/*   This is the entry point to the semantic checker.
+
+     Your checker should do the following two things:
+
+     1) Check that the program is semantically correct
+     2) Decorate the abstract syntax tree with type information
+        by setting the `type' field in each Expression node.
+        (see `tree.h')
+
+     You are free to first do 1), make sure you catch all semantic
+     errors. Part 2) can be done in a second stage, when you want
+     to build mycoolc.
+ */
+void program_class::semant(){
+    PhaseClock phase;
+    AllocScope alloc(ALLOC_CLASSES);
+    initialize_constants();
+    std::vector<SemantContext *> contexts;
+
+    //install all classes
+    phase.begin("ClassTable construction");
+    ClassTable *classtable = new ClassTable(classes);
+    
+    // record attr and methods
+    phase.begin("initialize_class_contents");
+    classtable->initialize_class_contents();
+    
+    // record what children classes have
+    phase.begin("initialize_inheritance_tree");
+    classtable->initialize_inheritance_tree();
+    
+    // make sure that the classes are well formed
+    phase.begin("validate_classes");
+    classtable->validate_classes();
+    
+    // check methods and attributes for problems
+    phase.begin("validate_features");
+    classtable->validate_features();
+
+    // number the methods of every class for dispatch, and find which
+    // calls can only have one target
+    phase.begin("dispatch tables");
+    if(classtable->classExists(Object)){
+        classtable->layout_dispatch_tables();
+        classtable->find_overrides();
+        classtable->assign_tags();
+    }
+    
+    //one context per checking thread; deep programs would overflow
+    //the C++ stack in the recursive expression checker
+    do{
+        contexts.push_back(new SemantContext(classtable, classtable->get_diagnostics()));
+        contexts.back()->iterative = ast_parse_depth > semant_iterative_depth;
+    }while((int) contexts.size() < semant_parallel);
+
+    // everything below walks parent chains, which is only safe for the
+    // classes that were installed and descend from Object.  The others
+    // have been reported already.
+    phase.begin("check classes");
+    alloc.set(ALLOC_CHECKER);
+    std::vector<Class_> given, installed, user_classes;
+    classes->elements(given);
+    for(size_t i = 0; i < given.size(); i++) {
+        Class_ c = given[i];
+        if(classtable->classExists(c->get_name()) && classtable->getClass(c->get_name()) == c){
+            installed.push_back(c);
+            if(classtable->isRooted(c->get_name())){
+                user_classes.push_back(c);
+            }
+        }
+    }
+    if(semant_incremental_state != NULL){
+        semant_incremental(*contexts[0], installed, user_classes);
+    }else if(semant_parallel){
+        semant_features_parallel(contexts, user_classes, classtable->get_diagnostics());
+    }else{
+        for(size_t i = 0; i < user_classes.size(); i++){
+            semant_one_class(*contexts[0], user_classes[i]);
+        }
+    }
+    if(cgen_optimize && semant_incremental_state == NULL){
+        phase.begin("fold");
+        alloc.set(ALLOC_AST);
+        for(size_t i = 0; i < user_classes.size(); i++){
+            fold_class(user_classes[i]);
+        }
+    }
+
+    // drop what Main.main cannot reach, and number the dispatch tables
+    // of what is left.  Incremental runs do not resolve the calls in the
+    // classes they reuse, so they are not pruned.
+    if(semant_prune && semant_incremental_state == NULL && !classtable->errors()){
+        phase.begin("prune");
+        alloc.set(ALLOC_AST);
+        Reachability reach(classtable);
+        reach.run();
+        Classes kept = nil_Classes();
+        int methods = 0, kept_methods = 0;
+        for(size_t i = 0; i < given.size(); i++) {
+            Class_ c = given[i];
+            Features features = c->getFeatures();
+            for(int j = features->first(); features->more(j); j = features->next(j)) {
+                if(features->nth(j)->isMethod()){
+                    methods++;
+                    kept_methods += reach.kept(c->get_name()) && reach.reached(c->get_name(), features->nth(j)->get_name());
+                }
+            }
+            if(reach.kept(c->get_name())){
+                c->prune_methods(reach);
+                kept = append_Classes(kept, single_Classes(c));
+            }else{
+                classtable->forget_class(c);
+            }
+        }
+        if(semant_debug){
+            cerr << "reachability: kept " << kept->len() << " of " << classes->len() << " classes, "
+                 << kept_methods << " of " << methods << " methods" << endl;
+        }
+        classes = kept;
+        classtable->layout_dispatch_tables(true);
+        classtable->find_overrides();
+        classtable->assign_tags();
+        reach.relink();
+    }
+    class_tags = classtable->class_tags();
+    phase.stop();
+    if(semant_stats){
+        for(size_t i = 0; i < contexts.size(); i++){
+            stats_add_counters(contexts[i]->counters);
+        }
+    }
+
+    if(semant_debug && semant_memoize){
+        int hits = 0, misses = 0;
+        for(size_t i = 0; i < contexts.size(); i++){
+            hits += contexts[i]->conform_cache.hits;
+            misses += contexts[i]->conform_cache.misses;
+        }
+        cerr << "conformance cache: " << hits << " hits, " << misses << " misses" << endl;
+    }
+    if(semant_debug){
+        int mono = 0, poly = 0;
+        for(size_t i = 0; i < contexts.size(); i++){
+            mono += contexts[i]->monomorphic_sites;
+            poly += contexts[i]->polymorphic_sites;
+        }
+        cerr << "dispatch sites: " << mono << " monomorphic, " << poly << " polymorphic" << endl;
+    }
+
+    // what the checker was doing, for working out where errors came from
+    if(semant_debug && classtable->errors()){
+        trace_dump(cerr);
+    }
+
+    phase.begin("diagnostics");
+    classtable->get_diagnostics().flush(cerr, semant_json_diagnostics);
+
+    if (classtable->errors() && !semant_json_diagnostics) {
+	    cerr << "Compilation halted due to static semantic errors." << endl;
+	    //exit(1);
+    }
+    if(semant_alloc_stats){
+        phase.stop();
+        alloc_report(cerr);
+    }
+}
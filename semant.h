@@ -7,7 +7,13 @@
 #include "stringtab.h"
 #include "symtab.h"
 #include "list.h"
+#include "semant-stats.h"
 #include <map>
+#include <set>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <sstream>
 
 #define TRUE 1
 #define FALSE 0
@@ -15,39 +21,173 @@
 class ClassTable;
 typedef ClassTable *ClassTableP;
 
+// remembered answers to conformance checks, with hit and miss counts
+struct ConformCache {
+  std::map<std::pair<Symbol, Symbol>, bool> results;
+  int hits;
+  int misses;
+  ConformCache() : hits(0), misses(0) { }
+};
+
+// Diagnostics are collected as records rather than written as they are
+// found.  report() opens a record and returns a stream for its message;
+// the message is taken when the next record is opened or the sink is
+// flushed.  flush() sorts the records by file and line, drops repeats and
+// writes them all in one call, as text or as JSON lines.
+struct Diagnostic {
+  Symbol filename;      // NULL for errors that belong to no file
+  int line;
+  Symbol class_name;    // NULL for errors outside any class
+  std::string code;
+  bool error;           // warnings are shown but not counted
+  std::string message;
+};
+
+class DiagnosticSink {
+private:
+  std::vector<Diagnostic> records;
+  std::ostringstream pending;
+  bool has_pending;
+  void commit();
+public:
+  DiagnosticSink() : has_pending(false) { }
+  ostream& report(Symbol filename, int line, Symbol class_name, const char *code, bool error);
+  void add(const Diagnostic &d) { commit(); records.push_back(d); }
+  const std::vector<Diagnostic>& get_records() { commit(); return records; }
+  void append(DiagnosticSink &other);
+  void flush(ostream& out, bool json);
+};
+
 // This is a structure that may be used to contain the semantic
 // information such as the inheritance graph.  You may use it or not as
 // you like: it is only here to provide a container for the supplied
 // methods.
 
+// The basic classes (Object, IO, Int, Bool and String) are identical in every
+// program.  They are built and flattened once per process and then shared,
+// read-only, by every ClassTable constructed afterwards.
+class BasicClasses {
+private:
+  Classes classes;
+  BasicClasses();
+public:
+  static BasicClasses *get();
+  Classes get_classes() { return classes; }
+};
+
 class ClassTable {
 private:
   std::map<Symbol, Class_> *class_table;
-  int semant_errors;
+  std::map<Symbol, std::list<Class_> > *child_table;
+  std::set<Symbol> *rooted_classes;
+  std::map<Symbol, std::vector<bool> > *overridden_below;
+  std::vector<ClassTag> *tags;               // in preorder
+  std::map<Symbol, int> *tag_index;          // where each class is in tags
+  std::atomic<int> semant_errors;
   void install_basic_classes();
-  ostream& error_stream;
+  DiagnosticSink diagnostics;
+  bool conforms(Symbol s1, Symbol s2, ConformCache *cache);
 
 
 public:
   ClassTable(Classes);
   int errors() { return semant_errors; }
-  ostream& semant_error();
-  ostream& semant_error(Class_ c);
-  ostream& semant_error(Symbol filename, tree_node *t);
+  DiagnosticSink& get_diagnostics() { return diagnostics; }
+  ostream& semant_error(const char *code);
+  ostream& semant_error(Class_ c, const char *code);
+  ostream& semant_error(Class_ c, tree_node *t, const char *code);
+  ostream& semant_error(DiagnosticSink& sink, Class_ c, tree_node *t, const char *code);
+  void replay(const Diagnostic &d);
   void install_class(Symbol id, Class_ cls);
   void initialize_class_contents();
   void initialize_inheritance_tree();
   void validate_classes();
   void validate_features();
+  void layout_dispatch_tables(bool again = false);
+  void find_overrides();
+  bool isMonomorphic(Symbol cls, int slot);
+  void assign_tags();
+  std::vector<ClassTag> *class_tags() { return tags; }
+  ClassTag *tag_of(Symbol cls);
+  Symbol common_ancestor(int lo, int hi);
+  void forget_class(Class_ c);
+  Symbol lub(Symbol s1, Symbol s2, Class_ current);
   bool isMismatchedOverride(Feature cmethod, Feature pmethod);
   bool identicalFormals(Formals f1, Formals f2);
+  bool inherits(Symbol s1, Symbol s2, Class_ current, ConformCache *cache);
+  bool classExists(Symbol s1);
+  bool isRooted(Symbol s1);
+  Class_ getClass(Symbol s1);
+  std::list<Class_> *getChildren(Symbol s1);
+  Symbol get_attr(Class_ cls, Symbol s1);
+  Feature get_method(Class_ cls, Symbol method);
+};
+
+// The state of one checker: the class it is in, the scopes opened inside
+// that class's features, its conformance cache and where its diagnostics
+// go.  Every semant() takes one, so several can share a ClassTable.
+class SemantContext {
+public:
+  ClassTable *classtable;
+  Class_ cls;
+  SymbolTable<Symbol, Symbol> *scope;
+  ConformCache conform_cache;
+  DiagnosticSink *diagnostics;
+  bool iterative;       // check expressions with an explicit stack
+  std::set<Symbol> *depends;  // when not NULL, the classes the checks looked at
+  std::vector<bool> branch_seen; // case branch types by tag, all false between cases
+  int monomorphic_sites;      // dispatches with only one possible target
+  int polymorphic_sites;
+  SemantCounters counters;    // for the -S report
+
+  SemantContext(ClassTable *ct, DiagnosticSink& sink);
+  void enter_class(Class_ c);
+  void enterscope();
+  ostream& semant_error(tree_node *t, const char *code);
+  ostream& warning(tree_node *t, const char *code);
+  void depends_on(Symbol s1);
   bool inherits(Symbol s1, Symbol s2);
+  Symbol lub(Symbol s1, Symbol s2);
   bool classExists(Symbol s1);
   Class_ getClass(Symbol s1);
-  void addToCurrentScope(Symbol name, Symbol type);
+  Symbol lookup_object(Symbol name);
+  void addToCurrentScope(tree_node *t, Symbol name, Symbol type);
+};
+
+// Whole-program reachability from Main.main, for pruning (-D).  A class
+// is kept if code that can run names it, or a kept class inherits from
+// it; a method is kept if a call that can run may reach it, with the
+// targets of a dynamic dispatch found by class hierarchy analysis.  Once
+// the tree is pruned and the dispatch tables laid out again, relinking
+// visits the same code to renumber the dispatch slots.
+class Reachability {
+private:
+  std::set<Symbol> kept_classes;
+  std::set<std::pair<Symbol, Symbol> > reached_methods;
+  std::set<std::pair<Symbol, int> > dispatched;
+  std::vector<std::pair<Class_, Feature> > pending;
+
+public:
+  ClassTable *classtable;
+  Class_ cls;                 // class of the code being visited
+  bool relinking;
+  Reachability(ClassTable *ct) : classtable(ct), cls(NULL), relinking(false) {}
+  void run();
+  void relink();
+  void keep_class(Symbol name);
+  void reach_method(Symbol owner, Symbol name);
+  void reach_dispatch(Symbol receiver, int slot);
+  void visit(Expression e);
+  bool kept(Symbol name) { return kept_classes.count(name) > 0; }
+  bool reached(Symbol owner, Symbol name) { return reached_methods.count(std::make_pair(owner, name)) > 0; }
+  int classes_kept() { return kept_classes.size(); }
+  int methods_reached() { return reached_methods.size(); }
 };
 
 // reducing clutter in semant.cc
+Classes join3_Classes(Class_ c1, Class_ c2, Class_ c3){
+    return append_Classes(append_Classes(single_Classes(c1),single_Classes(c2)),single_Classes(c3));
+}
 Features join3_Features(Feature f1, Feature f2, Feature f3){
     return append_Features(append_Features(single_Features(f1),single_Features(f2)),single_Features(f3));
 }
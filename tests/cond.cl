@@ -0,0 +1,7 @@
+class Shape { area() : Int { 0 }; };
+class Square inherits Shape { side : Int <- 2; area() : Int { side * side }; };
+class Circle inherits Shape { r : Int <- 1; area() : Int { 3 * r * r }; };
+class Main {
+  pick(round : Bool) : Shape { if round then new Circle else new Square fi };
+  main() : Int { pick(true).area() };
+};
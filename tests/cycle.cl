@@ -0,0 +1,5 @@
+class A inherits C { };
+class C inherits A { };
+class D inherits D { };
+class E inherits A { };
+class Main { main() : Int { 0 }; };
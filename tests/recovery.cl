@@ -0,0 +1,8 @@
+class A { f() : Int { 1 }; f() : Int { 2 }; self : Int; a : Int; a : Bool; };
+class A { g() : Int { 3 }; };
+class SELF_TYPE { };
+class B inherits Missing { h() : Int { 4 }; };
+class C inherits B { };
+class D { c : C; d : Int <- c.h() + true; e : Nope; k() : Gone { e }; };
+class Int { };
+class Main { main() : Int { new D.k() + 1 }; };
@@ -0,0 +1 @@
+class Main { main() : Object { { x; not 1; x; not 1; } }; };
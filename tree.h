@@ -17,6 +17,7 @@
 
 #include "stringtab.h"
 #include "cool-io.h"
+#include <vector>
 
 /////////////////////////////////////////////////////////////////////
 //
@@ -116,6 +117,9 @@ template <class Elem> class list_node : public tree_node {
 public:
     tree_node *copy()            { return copy_list(); }
     Elem nth(int n);
+    Elem *nth_slot(int n);
+    void elements(std::vector<Elem> &out);
+    void slots(std::vector<Elem *> &out);
     //
     // The next three define a simple iterator.
     //
@@ -127,6 +131,8 @@ public:
     virtual ~list_node() { }
     virtual int len() = 0;
     virtual Elem nth_length(int n, int &len) = 0;
+    virtual Elem *slot_length(int n, int &len) = 0;
+    virtual void expand(std::vector<list_node<Elem> *> &todo, std::vector<Elem *> &out) = 0;
 
     static list_node<Elem> *nil();
     static list_node<Elem> *single(Elem);
@@ -142,6 +148,8 @@ public:
     list_node<Elem> *copy_list();
     int len();
     Elem nth_length(int n, int &len);
+    Elem *slot_length(int n, int &len);
+    void expand(std::vector<list_node<Elem> *> &todo, std::vector<Elem *> &out);
     void dump(ostream& stream, int n);
 };
 
@@ -154,6 +162,8 @@ public:
     list_node<Elem> *copy_list();
     int len();
     Elem nth_length(int n, int &len);
+    Elem *slot_length(int n, int &len);
+    void expand(std::vector<list_node<Elem> *> &todo, std::vector<Elem *> &out);
     void dump(ostream& stream, int n);
 };
 
@@ -170,6 +180,8 @@ public:
     int len();
     Elem nth(int n);
     Elem nth_length(int n, int &len);
+    Elem *slot_length(int n, int &len);
+    void expand(std::vector<list_node<Elem> *> &todo, std::vector<Elem *> &out);
     void dump(ostream& stream, int n);
 };
 
@@ -207,6 +219,42 @@ template <class Elem> Elem list_node<Elem>::nth(int n)
     }
 }
 
+// the place where the nth element is stored, so that it can be replaced
+template <class Elem> Elem *list_node<Elem>::nth_slot(int n)
+{
+    int len;
+    Elem *tmp = slot_length(n ,len);
+
+    if (tmp)
+	return tmp;
+    else {
+	cerr << "error: outside the range of the list\n";
+	exit(1);
+    }
+}
+
+// appends where each element of the list is stored to `out' in order,
+// so that elements can be replaced.  Unlike a loop over nth_slot, this
+// takes time linear in the length of the list.
+template <class Elem> void list_node<Elem>::slots(std::vector<Elem *> &out)
+{
+    std::vector<list_node<Elem> *> todo(1, this);
+    while (!todo.empty()) {
+	list_node<Elem> *l = todo.back();
+	todo.pop_back();
+	l->expand(todo, out);
+    }
+}
+
+// appends the elements of the list to `out' in order, like slots
+template <class Elem> void list_node<Elem>::elements(std::vector<Elem> &out)
+{
+    std::vector<Elem *> where;
+    slots(where);
+    for (size_t i = 0; i < where.size(); i++)
+	out.push_back(*where[i]);
+}
+
 // added 10/30/06 cgs
 template <class Elem> Elem append_node<Elem>::nth(int n)
 {
@@ -261,6 +309,16 @@ template <class Elem> Elem nil_node<Elem>::nth_length(int, int &len)
     return NULL;
 }
 
+template <class Elem> Elem *nil_node<Elem>::slot_length(int, int &len)
+{
+    len = 0;
+    return NULL;
+}
+
+template <class Elem> void nil_node<Elem>::expand(std::vector<list_node<Elem> *> &, std::vector<Elem *> &)
+{
+}
+
 
 ///////////////////////////////////////////////////////////////////////////
 //
@@ -318,6 +376,29 @@ template <class Elem> Elem single_list_node<Elem>::nth_length(int n, int &len)
 }
 
 
+///////////////////////////////////////////////////////////////////////////
+//
+// single_list_node::slot_length
+//
+// like nth_length, but returns where the element is stored so that it
+// can be replaced
+//
+///////////////////////////////////////////////////////////////////////////
+template <class Elem> Elem *single_list_node<Elem>::slot_length(int n, int &len)
+{
+    len = 1;
+    if (n)
+	return NULL;
+    else
+	return &elem;
+}
+
+template <class Elem> void single_list_node<Elem>::expand(std::vector<list_node<Elem> *> &, std::vector<Elem *> &out)
+{
+    out.push_back(&elem);
+}
+
+
 ///////////////////////////////////////////////////////////////////////////
 //
 // single_list_node::dump
@@ -376,6 +457,25 @@ template <class Elem> Elem append_node<Elem>::nth_length(int n, int &len)
     return tmp;
 }
 
+// the two halves go on the stack rest first, so some is expanded first
+template <class Elem> void append_node<Elem>::expand(std::vector<list_node<Elem> *> &todo, std::vector<Elem *> &)
+{
+    todo.push_back(rest);
+    todo.push_back(some);
+}
+
+template <class Elem> Elem *append_node<Elem>::slot_length(int n, int &len)
+{
+    int rlen;
+    Elem *tmp = some->slot_length(n, len);
+
+    if (!tmp) {
+	tmp = rest->slot_length(n-len, rlen);
+	len += rlen;
+    }
+    return tmp;
+}
+
 
 ///////////////////////////////////////////////////////////////////////////
 //